@@ -53,7 +53,7 @@ int main(int argc, const char **argv) {
 	auto vfs = kasofs::Vfs{currentUser, kasofs::FilePermissions{0777}};
 
 	// Register RamVFS driver
-	auto maybeRamFsDriverId = vfs.registerFilesystem<RamFS>(4096);
+	auto maybeRamFsDriverId = vfs.registerFilesystem<RamFS>(64 * 1024 * 1024);
 	if (!maybeRamFsDriverId) {
 		std::cerr << "Failed to register RAM fs driver: " << maybeRamFsDriverId.getError() << '\n';
 		return EXIT_FAILURE;
@@ -0,0 +1,137 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		chunkedArray.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_CHUNKEDARRAY_HPP
+#define KASOFS_CHUNKEDARRAY_HPP
+
+#include <solace/types.hpp>
+
+#include <array>
+#include <atomic>
+#include <new>
+#include <utility>
+
+
+namespace kasofs {
+
+/**
+ * Array that grows in chunks, so that elements never move once constructed.
+ *
+ * Chunk k holds kFirstChunkSize * 2^k elements, so a fixed number of chunks covers the whole range of indices
+ * and the array never needs to copy or re-publish its index of chunks.
+ * Elements can be read by any number of threads without locking while a single writer appends new elements:
+ * a new element is published by an atomic update of the size of the array.
+ * Note: Writers must be serialized by the caller.
+ */
+template<typename T>
+struct ChunkedArray {
+	using size_type = Solace::uint32;
+
+	/// Number of elements in the first chunk is 2^kFirstChunkBits
+	static constexpr size_type kFirstChunkBits = 6;
+	static constexpr size_type kFirstChunkSize = size_type{1} << kFirstChunkBits;
+
+	/// Number of chunks to address any 32bit index
+	static constexpr size_type kMaxChunks = 33 - kFirstChunkBits;
+
+	ChunkedArray() noexcept = default;
+
+	~ChunkedArray() {
+		auto const nElements = size();
+		for (size_type i = 0; i < nElements; ++i) {
+			(*this)[i].~T();
+		}
+
+		for (auto& chunk : _chunks) {
+			::operator delete(chunk.load(std::memory_order_relaxed));
+		}
+	}
+
+	ChunkedArray(ChunkedArray const&) = delete;
+	ChunkedArray& operator= (ChunkedArray const&) = delete;
+
+	/// Number of elements published to readers
+	size_type size() const noexcept { return _size.load(std::memory_order_acquire); }
+
+	bool empty() const noexcept { return size() == 0; }
+
+	/// Access an element. Index must be less than the size of the array.
+	T& operator[] (size_type index) noexcept {
+		auto const location = locate(index);
+		return _chunks[location.chunk].load(std::memory_order_acquire)[location.offset];
+	}
+
+	T const& operator[] (size_type index) const noexcept {
+		auto const location = locate(index);
+		return _chunks[location.chunk].load(std::memory_order_acquire)[location.offset];
+	}
+
+	/**
+	 * Construct a new element at the end of the array and publish it.
+	 * @return Reference to the new element.
+	 */
+	template<typename...Args>
+	T& emplace_back(Args&& ...args) {
+		auto const index = _size.load(std::memory_order_relaxed);
+		auto const location = locate(index);
+
+		auto* chunk = _chunks[location.chunk].load(std::memory_order_relaxed);
+		if (!chunk) {
+			chunk = static_cast<T*>(::operator new(sizeof(T) * chunkSize(location.chunk)));
+			_chunks[location.chunk].store(chunk, std::memory_order_release);
+		}
+
+		auto* element = new (chunk + location.offset) T(std::forward<Args>(args)...);
+		_size.store(index + 1, std::memory_order_release);
+
+		return *element;
+	}
+
+private:
+
+	struct Location {
+		size_type	chunk;
+		size_type	offset;
+	};
+
+	static constexpr Solace::uint64 chunkSize(size_type chunk) noexcept {
+		return Solace::uint64{kFirstChunkSize} << chunk;
+	}
+
+	static Location locate(size_type index) noexcept {
+		// Chunk k starts at index kFirstChunkSize * (2^k - 1), so the chunk is given by the highest bit of the position
+		auto const position = Solace::uint64{index} + kFirstChunkSize;
+		auto const chunk = highestBit(position) - kFirstChunkBits;
+
+		return {chunk, static_cast<size_type>(position - chunkSize(chunk))};
+	}
+
+	static size_type highestBit(Solace::uint64 value) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<size_type>(63 - __builtin_clzll(value));
+#else
+		size_type bit = 0;
+		while (value >>= 1) {
+			bit += 1;
+		}
+
+		return bit;
+#endif
+	}
+
+	std::array<std::atomic<T*>, kMaxChunks>	_chunks{};
+	std::atomic<size_type>					_size{0};
+};
+
+}  // namespace kasofs
+#endif  // KASOFS_CHUNKEDARRAY_HPP
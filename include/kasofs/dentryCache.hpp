@@ -0,0 +1,213 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		dentryCache.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_DENTRYCACHE_HPP
+#define KASOFS_DENTRYCACHE_HPP
+
+#include "vinode.hpp"
+#include "namePool.hpp"
+#include "directoryDriver.hpp"
+
+#include <array>
+#include <cstring>  // memcpy
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace kasofs {
+
+/**
+ * Cache of resolved paths.
+ *
+ * Cache is direct-mapped: a path resolved from a given start node maps to exactly one record,
+ * so a lookup is a single probe. A record remembers every directory traversed to resolve the path
+ * along with the version each directory had at the time. Vfs bumps the version of a directory whenever an entry is
+ * linked or unlinked, so a record is valid only as long as versions of all the directories on its chain match.
+ * Paths that failed to resolve because a name was missing are cached too, as negative records, so that repeated
+ * probes for non-existent files do not walk the path again. Such a record is invalidated as soon as
+ * the directory where the name was missing is modified.
+ * Records are guarded by locks striped by record, so that walks of different paths rarely contend.
+ * Note: The cache is not aware of users. Caller must check permissions along the chain on every hit.
+ */
+struct DentryCache {
+	using size_type = Solace::uint32;
+
+	/// Number of locks records are striped over
+	static constexpr size_type kLockStripes = 16;
+
+	/// A directory traversed while resolving a path, along with the version it had at the time.
+	struct Step {
+		INode::Id		dirId;
+		Solace::uint32	version;
+	};
+
+	/// Cached path resolution
+	struct Record {
+		Record() noexcept
+			: startId{0, 0}
+			, result{Solace::StringView{}, INode::Id{0, 0}}
+		{}
+
+		bool				isValid{false};
+		bool				isNegative{false};	//!< True if path does not resolve as a name along the path is missing
+		INode::Id			startId;		//!< Id of the node path is resolved from
+		std::size_t			pathHash{0};
+		std::string			path;			//!< Encoded path segments to tell apart paths with the same hash
+		std::vector<Step>	chain;			//!< Directories traversed to resolve the path, starting with startId
+		Entry				result;			//!< Resolved entry. Not used by negative records
+	};
+
+	struct Stats {
+		Solace::uint64	hits{0};
+		Solace::uint64	misses{0};
+		Solace::uint64	stale{0};		//!< Number of records found to be out of date
+		Solace::uint64	negativeHits{0};	//!< Number of hits that resolved to a missing name
+	};
+
+	/**
+	 * Construct a new cache
+	 * @param capacity Number of records in the cache. Rounded up to the power of 2.
+	 */
+	explicit DentryCache(size_type capacity);
+
+	size_type capacity() const noexcept { return static_cast<size_type>(_records.size()); }
+
+	/// Statistics of all records, collected stripe by stripe
+	Stats stats() const;
+
+	/**
+	 * Lock the stripe of records a path maps to.
+	 * Records found and inserted for the path are only valid while the lock is held.
+	 */
+	std::unique_lock<std::mutex> lock(std::size_t pathHash) const {
+		return std::unique_lock<std::mutex>{stripeOf(pathHash).lock};
+	}
+
+	template<typename P>
+	static std::size_t hashOf(INode::Id startId, P const& path) noexcept {
+		std::size_t h = (static_cast<std::size_t>(startId.index) << 32) ^ startId.gen;
+		for (auto segment : path) {
+			h = (h ^ EntryName::hashOf(segment)) * kHashPrime;
+		}
+
+		return h;
+	}
+
+	/**
+	 * Find a record of a previously resolved path.
+	 * @return A pointer to the record if the path is cached, nullptr otherwise.
+	 * @note Returned record can be out of date and must be validated by the caller.
+	 * @note Caller must hold the lock of the path, see DentryCache::lock.
+	 */
+	template<typename P>
+	Record const* find(INode::Id startId, std::size_t pathHash, P const& path) noexcept {
+		auto& stats = stripeOf(pathHash).stats;
+		auto const& record = _records[pathHash & _mask];
+		if (!record.isValid || record.pathHash != pathHash || !(record.startId == startId) || !matches(record, path)) {
+			stats.misses += 1;
+			return nullptr;
+		}
+
+		stats.hits += 1;
+		if (record.isNegative) {
+			stats.negativeHits += 1;
+		}
+
+		return &record;
+	}
+
+	/**
+	 * Cache a path resolution, replacing any other record in its place.
+	 */
+	template<typename P>
+	void insert(INode::Id startId, std::size_t pathHash, P const& path, std::vector<Step> const& chain, Entry result) {
+		auto& record = emplace(startId, pathHash, path, chain);
+		record.result = result;
+	}
+
+	/**
+	 * Cache a path that does not resolve, as the last directory on the chain has no entry with the next name.
+	 */
+	template<typename P>
+	void insertNegative(INode::Id startId, std::size_t pathHash, P const& path, std::vector<Step> const& chain) {
+		auto& record = emplace(startId, pathHash, path, chain);
+		record.isNegative = true;
+	}
+
+	/// Drop a record that was found to be out of date.
+	void evict(Record const& record) noexcept;
+
+	/// Drop all records
+	void clear() noexcept;
+
+private:
+	static constexpr std::size_t kHashPrime = 1099511628211ULL;
+
+	/// Lock of a stripe of records, along with statistics of the records. Stripes are aligned to a cache line.
+	struct alignas(64) Stripe {
+		std::mutex	lock;
+		Stats		stats;
+	};
+
+	Stripe& stripeOf(std::size_t pathHash) const noexcept {
+		return _stripes[(pathHash & _mask) % kLockStripes];
+	}
+
+	template<typename P>
+	Record& emplace(INode::Id startId, std::size_t pathHash, P const& path, std::vector<Step> const& chain) {
+		auto& record = _records[pathHash & _mask];
+		record.isValid = true;
+		record.isNegative = false;
+		record.startId = startId;
+		record.pathHash = pathHash;
+		record.chain.assign(chain.begin(), chain.end());
+
+		record.path.clear();
+		for (auto segment : path) {  // Each segment is encoded as its size followed by the segment bytes
+			auto const segmentSize = segment.size();
+			record.path.append(reinterpret_cast<char const*>(&segmentSize), sizeof(segmentSize));
+			record.path.append(segment.data(), segmentSize);
+		}
+
+		return record;
+	}
+
+	template<typename P>
+	static bool matches(Record const& record, P const& path) noexcept {
+		auto const* it = record.path.data();
+		auto const* end = it + record.path.size();
+		for (auto segment : path) {
+			auto segmentSize = segment.size();
+			if (static_cast<std::size_t>(end - it) < sizeof(segmentSize) + segmentSize)
+				return false;
+
+			decltype(segmentSize) storedSize;
+			std::memcpy(&storedSize, it, sizeof(storedSize));
+			it += sizeof(storedSize);
+			if (storedSize != segmentSize || 0 != std::memcmp(it, segment.data(), segmentSize))
+				return false;
+
+			it += segmentSize;
+		}
+
+		return (it == end);
+	}
+
+	std::vector<Record>							_records;
+	std::size_t									_mask;
+	mutable std::array<Stripe, kLockStripes>	_stripes;
+};
+
+}  // namespace kasofs
+#endif  // KASOFS_DENTRYCACHE_HPP
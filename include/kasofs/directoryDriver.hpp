@@ -16,9 +16,14 @@
 
 #include "vinode.hpp"
 #include "fs.hpp"
+#include "namePool.hpp"
+#include "directoryEntries.hpp"
+#include "chunkedArray.hpp"
+#include "epochReclaimer.hpp"
 
 
-#include <unordered_map>
+#include <mutex>
+#include <vector>
 
 
 namespace kasofs {
@@ -39,10 +44,14 @@ struct Entry {
 /**
  * Helper class for directory enumerator.
  * Enables easy for-each loop
+ * Enumerator holds a copy of the entries, taken when the directory is enumerated,
+ * so that the directory can be modified while it is being enumerated.
+ * Enumerator of a live directory pins the directory node until it is destroyed.
  */
 struct EntriesEnumerator {
-	using Entries = std::unordered_map<std::string, INode::Id>;
-	using Iter = Entries::const_iterator;
+	using Entries = DirectoryEntries;
+	using Version = Entries::Version;
+	using Iter = std::vector<Entry>::const_iterator;
 
 	struct Iterator {
 
@@ -64,7 +73,7 @@ struct EntriesEnumerator {
 		}
 
 		Entry operator-> () const {
-			return Entry{Solace::StringView(_position->first.data(), _position->first.size()), _position->second};
+			return *_position;
 		}
 
 		Iter _position;
@@ -73,23 +82,42 @@ struct EntriesEnumerator {
 
 	~EntriesEnumerator();
 
-	EntriesEnumerator(struct Vfs& vfs, INode::Id dirId, Entries const& entries) noexcept;
+	EntriesEnumerator(struct Vfs& vfs, INode::Id dirId, Entries const& entries);
+
+	/// Enumerate entries of a directory as it was at the given version of the namespace. Caller must be pinned.
+	EntriesEnumerator(Entries const& entries, Version version);
+
+	EntriesEnumerator(EntriesEnumerator const&) = delete;
+	EntriesEnumerator& operator= (EntriesEnumerator const&) = delete;
+
+	EntriesEnumerator(EntriesEnumerator&& rhs) noexcept;
+	EntriesEnumerator& operator= (EntriesEnumerator&&) = delete;
 
 	auto begin() const noexcept  { return Iterator{_entries.begin(), _entries.end()}; }
 	auto end() const noexcept    { return Iterator{_entries.end(), _entries.end()}; }
 
 private:
-	Vfs&			_vfs;
-	INode::Id		_dirId;
-	Entries const&	_entries;
+	void copyEntries(Entries const& entries, Version version);
+
+	Vfs*				_vfs;
+	INode::Id			_dirId;
+	std::vector<char>	_names;		//!< Names of the entries
+	std::vector<Entry>	_entries;	//!< Entries, with names pointing into _names
 };
 
 
 
 
+/**
+ * Driver of directory nodes.
+ * Entries of directories can be looked up and counted without locking: readers must be pinned with
+ * EpochReclaimer::pin for as long as they use an entry they found.
+ * Modifications of a directory must be serialized by the caller, but different directories can be modified concurrently.
+ */
 struct DirFs final : public Filesystem {
 
-	using Entries = std::unordered_map<std::string, INode::Id>;
+	using Entries = EntriesEnumerator::Entries;
+	using Version = Entries::Version;
 
 	static VfsId const kTypeId;
 	static VfsNodeType const kNodeType;
@@ -116,14 +144,24 @@ struct DirFs final : public Filesystem {
 
 	auto close(OpenFID, INode&) -> Result<void> override;
 
+	/// Add an entry to a directory, in the given version of the namespace
 	Result<void>
-	addEntry(INode& dirNode, Entry entry);
+	addEntry(INode& dirNode, Entry entry, Version version);
 
+	/**
+	 * Remove an entry from a directory, in the given version of the namespace.
+	 * @param isRetained If true, the entry remains visible to earlier versions until it is purged.
+	 * @return Id of the node the removed entry linked to, or none if there was no such entry.
+	 */
 	Result<Solace::Optional<INode::Id>>
-	removeEntry(INode& dirNode, Solace::StringView name);
+	removeEntry(INode& dirNode, Solace::StringView name, Version version, bool isRetained);
 
+	/**
+	 * Find an entry of a directory. Lock-free: name of the entry remains valid while the caller is pinned.
+	 * @param version Version of the namespace to find the entry in.
+	 */
 	Solace::Optional<Entry>
-	lookup(INode const& dirNode, Solace::StringView name) const noexcept;
+	lookup(INode const& dirNode, Solace::StringView name, Version version = Entries::kLatest) const noexcept;
 
 	size_type
 	countEntries(INode const& dirNode) const noexcept;
@@ -131,6 +169,22 @@ struct DirFs final : public Filesystem {
 	Result<EntriesEnumerator>
 	enumerateEntries(Vfs& vfs, INode::Id dirNodeId, INode const& dirNode) const noexcept;
 
+	/// Enumerate entries of a directory as it was at the given version. Caller must be pinned.
+	Result<EntriesEnumerator>
+	enumerateEntries(INode const& dirNode, Version version) const noexcept;
+
+	/**
+	 * Destroy removed entries of a directory that are not visible at any version from the given one onwards.
+	 * @return True if the directory still retains removed entries.
+	 */
+	bool purge(INode const& dirNode, Version oldestVersion);
+
+	/**
+	 * Destroy removed entries and directories that are no longer observable by readers.
+	 * @return Number of objects destroyed.
+	 */
+	EpochReclaimer::size_type collect() { return _reclaimer.collect(); }
+
 	static bool isDirectoryNode(INode const& node) noexcept {
 		return (kNodeType == node.nodeTypeId);
 	}
@@ -138,12 +192,38 @@ struct DirFs final : public Filesystem {
 private:
 
 	using DataId = INode::VfsData;
-	DataId nextId() noexcept { return _idBase++; }
+	using NameHandle = NamePool::Handle;
+
+	/// Find entries of a directory node
+	Entries* entriesOf(INode const& dirNode) noexcept {
+		return (dirNode.vfsData < _directories.size())
+				? &_directories[static_cast<Solace::uint32>(dirNode.vfsData)]
+				: nullptr;
+	}
+
+	Entries const* entriesOf(INode const& dirNode) const noexcept {
+		return (dirNode.vfsData < _directories.size())
+				? &_directories[static_cast<Solace::uint32>(dirNode.vfsData)]
+				: nullptr;
+	}
+
+	/// Release names of removed entries once no reader can observe them
+	void releaseNames(std::vector<NameHandle> names);
+
+	/// Guards the name pool, Ids of destroyed directories and growth of the table of directories
+	mutable std::mutex					_lock;
+
+	/// Directory entries - Named Graph edges. Indexed by vfsData of a directory node.
+	ChunkedArray<Entries>				_directories;
+
+	/// Ids of destroyed directories. An Id is reused once no reader can observe the destroyed directory.
+	std::vector<DataId>					_freeIds;
 
-	DataId _idBase{0};
+	/// Names of directory entries, shared by all directories
+	NamePool							_names;
 
-	/// Directory entries - Named Graph edges
-	std::unordered_map<DataId, Entries> _adjacencyList;
+	/// Removed entries waiting to be destroyed. Declared last, so that it is destroyed before the state it refers to.
+	EpochReclaimer						_reclaimer;
 };
 
 
@@ -0,0 +1,208 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		directoryEntries.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_DIRECTORYENTRIES_HPP
+#define KASOFS_DIRECTORYENTRIES_HPP
+
+#include "vinode.hpp"
+#include "namePool.hpp"
+#include "epochReclaimer.hpp"
+
+#include <solace/optional.hpp>
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+namespace kasofs {
+
+/**
+ * Entries of a single directory: names mapped to node Ids.
+ *
+ * Entries are kept in an open addressing hash table of pointers to immutable slots, so that the directory
+ * can be searched and enumerated without locking while it is being modified.
+ * A slot is never changed once published: removing an entry replaces its pointer with a tombstone,
+ * and a table that needs to grow or shrink is rebuilt and published as a whole.
+ * Removed slots and replaced tables are retired to an EpochReclaimer, so readers must be pinned.
+ *
+ * Entries are versioned: each slot records the version of the namespace it was added in and the version
+ * it was removed in. A removed slot can be retained, so that the directory can still be read as it was
+ * at an earlier version, until it is purged.
+ * Note: Writers must be serialized by the caller.
+ */
+struct DirectoryEntries {
+	using size_type = Solace::uint32;
+	using NameHandle = NamePool::Handle;
+	using Version = Solace::uint64;
+
+	/// Min number of buckets of a non-empty table
+	static constexpr size_type kMinCapacity = 8;
+
+	/// Version a slot that has not been removed is removed in
+	static constexpr Version kNever = std::numeric_limits<Version>::max();
+
+	/// Version that sees all entries that have not been removed
+	static constexpr Version kLatest = kNever - 1;
+
+	/// Entry of the directory. Slot is retired without allocation once it is removed.
+	struct Slot : public EpochReclaimer::Retirable {
+		Slot(EntryName n, NameHandle h, INode::Id id, Version createdIn) noexcept
+			: name{n}
+			, handle{h}
+			, nodeId{id}
+			, created{createdIn}
+		{}
+
+		Slot(Slot const& rhs) noexcept
+			: EpochReclaimer::Retirable{rhs}
+			, name{rhs.name}
+			, handle{rhs.handle}
+			, nodeId{rhs.nodeId}
+			, created{rhs.created}
+			, removed{rhs.removed.load(std::memory_order_acquire)}
+		{}
+
+		Slot& operator= (Slot const&) = delete;
+
+		/// Test if the entry exists in the given version of the namespace
+		bool isVisibleAt(Version version) const noexcept {
+			return (created <= version) && (version < removed.load(std::memory_order_acquire));
+		}
+
+		EntryName	name;		//!< Name of the entry, viewing the storage of an interned name
+		NameHandle	handle;		//!< Handle of the interned name
+		INode::Id	nodeId;		//!< Node the entry links to
+		Version		created;	//!< Version the entry was added in
+
+		/// Version the entry was removed in. The only field that changes once the slot is published.
+		mutable std::atomic<Version>	removed{kNever};
+	};
+
+	DirectoryEntries() noexcept = default;
+
+	/// Destroy all entries. Owner must make sure there are no readers left.
+	~DirectoryEntries();
+
+	DirectoryEntries(DirectoryEntries const&) = delete;
+	DirectoryEntries& operator= (DirectoryEntries const&) = delete;
+
+	/**
+	 * Find an entry by name. Lock-free.
+	 * @param name Name of the entry.
+	 * @param version Version of the namespace to find the entry in.
+	 * @return Slot of the entry if it exists, null otherwise. Slot remains valid while the caller is pinned.
+	 */
+	Slot const* find(EntryName const& name, Version version = kLatest) const noexcept;
+
+	/**
+	 * Add a new entry.
+	 * @param version Version of the namespace the entry is added in.
+	 * @param reclaimer Reclaimer to retire the table to, if it has to be rebuilt.
+	 * @return True if the entry was added, false if an entry with the given name already exists.
+	 */
+	bool insert(EntryName name, NameHandle handle, INode::Id nodeId, Version version, EpochReclaimer& reclaimer);
+
+	/**
+	 * Remove an entry
+	 * @param version Version of the namespace the entry is removed in.
+	 * @param isRetained If true, the slot is kept so that earlier versions of the directory can still be read.
+	 * @param reclaimer Reclaimer to retire the removed slot to.
+	 * @return Copy of the removed entry, or none if there was no such entry.
+	 */
+	Solace::Optional<Slot> erase(EntryName const& name, Version version, bool isRetained, EpochReclaimer& reclaimer);
+
+	/**
+	 * Destroy retained slots that are not visible at any version from the given one onwards.
+	 * @param oldestVersion Oldest version of the namespace that may still be read. kLatest purges all retained slots.
+	 * @param reclaimer Reclaimer to retire the purged slots to.
+	 * @return Handles of names of the purged slots.
+	 */
+	std::vector<NameHandle> purge(Version oldestVersion, EpochReclaimer& reclaimer);
+
+	/// Remove all entries, including retained ones, retiring them to the given reclaimer
+	void clear(EpochReclaimer& reclaimer);
+
+	/// Number of entries that have not been removed
+	size_type size() const noexcept { return _size.load(std::memory_order_acquire); }
+	bool empty() const noexcept { return size() == 0; }
+
+	/// Number of removed slots retained for earlier versions
+	size_type retained() const noexcept { return _nRetained; }
+
+	/// Number of buckets of the table
+	size_type capacity() const noexcept {
+		auto const* table = _table.load(std::memory_order_acquire);
+		return table ? table->mask + 1 : 0;
+	}
+
+	/// Invoke a function for every entry of the directory. Lock-free.
+	template<typename F>
+	void forEach(F&& f) const {
+		forEachAt(kLatest, std::forward<F>(f));
+	}
+
+	/// Invoke a function for every entry of the directory as it was at the given version. Lock-free.
+	template<typename F>
+	void forEachAt(Version version, F&& f) const {
+		forEachSlot([version, &f](Slot const& slot) {
+			if (slot.isVisibleAt(version)) {
+				f(slot);
+			}
+		});
+	}
+
+private:
+
+	struct Table : public EpochReclaimer::Retirable {
+		explicit Table(size_type capacity);
+
+		size_type										mask;		//!< Number of buckets - 1
+		size_type										nUsed{0};	//!< Number of buckets holding a slot or a tombstone
+		std::unique_ptr<std::atomic<Slot const*>[]>		buckets;
+	};
+
+	/// Marker of a bucket that held a removed slot
+	static Slot const kTombstone;
+
+	/// Invoke a function for every slot of the table, including retained ones
+	template<typename F>
+	void forEachSlot(F&& f) const {
+		auto const* table = _table.load(std::memory_order_acquire);
+		if (!table)
+			return;
+
+		for (size_type i = 0; i <= table->mask; ++i) {
+			auto const* slot = table->buckets[i].load(std::memory_order_acquire);
+			if (slot && slot != &kTombstone) {
+				f(*slot);
+			}
+		}
+	}
+
+	/// Rebuild the table if it is too sparse
+	void shrink(EpochReclaimer& reclaimer);
+
+	/// Rebuild the table with the given number of buckets, without tombstones, and retire the old one
+	void rebuild(size_type capacity, EpochReclaimer& reclaimer);
+
+	std::atomic<Table*>		_table{nullptr};
+	std::atomic<size_type>	_size{0};
+	size_type				_nRetained{0};		//!< Number of removed slots kept in the table
+};
+
+
+}  // namespace kasofs
+#endif  // KASOFS_DIRECTORYENTRIES_HPP
@@ -0,0 +1,141 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		epochReclaimer.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_EPOCHRECLAIMER_HPP
+#define KASOFS_EPOCHRECLAIMER_HPP
+
+#include <solace/types.hpp>
+
+#include <atomic>
+#include <functional>
+#include <type_traits>
+
+
+namespace kasofs {
+
+/**
+ * Epoch based reclamation of memory shared with lock-free readers.
+ *
+ * A reader pins the current epoch for the duration of a read. A writer first makes an object unreachable
+ * for new readers, then retires it. A retired object is destroyed by a later call to collect, once every reader
+ * that could have reached it has unpinned.
+ * Pinning is a store to a slot owned by the reading thread followed by a fence: readers never write to a cache line
+ * shared with other threads. Epochs and slots of readers are global, so a single pin protects objects retired to
+ * any reclaimer.
+ * Retired objects are chained into an intrusive lock-free list: an object derived from Retirable is retired
+ * without locking or allocating memory. Other objects and functions are wrapped into an allocated record.
+ */
+struct EpochReclaimer {
+	using size_type = Solace::uint32;
+	using Epoch = Solace::uint64;
+
+	/// Max number of threads that can be pinned at the same time without contending for a shared counter
+	static constexpr size_type kMaxReaders = 128;
+
+	/// Number of retired objects that triggers a collection
+	static constexpr size_type kCollectThreshold = 64;
+
+	/**
+	 * Hook of an object that can be retired without allocation.
+	 * Hook is owned by the reclaimer once the object is retired: it is not copied with the object.
+	 */
+	struct Retirable {
+		Retirable() noexcept = default;
+		Retirable(Retirable const&) noexcept {}
+		Retirable& operator= (Retirable const&) noexcept { return *this; }
+
+	protected:
+		~Retirable() = default;
+
+	private:
+		friend struct EpochReclaimer;
+
+		using Destroy = void (*)(Retirable const*) noexcept;
+
+		mutable Retirable const*	_retiredNext{nullptr};	//!< Next object in the list of retired objects
+		mutable Epoch				_retiredEpoch{0};		//!< Epoch the object was retired in
+		mutable Destroy				_destroy{nullptr};
+	};
+
+	/// Pinned epoch of the thread. Pins nest: the epoch is unpinned once the outermost guard is destroyed.
+	struct Guard {
+		~Guard();
+
+		Guard(Guard const&) = delete;
+		Guard& operator= (Guard const&) = delete;
+
+		Guard(Guard&& rhs) noexcept;
+		Guard& operator= (Guard&&) = delete;
+
+	private:
+		friend struct EpochReclaimer;
+
+		Guard() noexcept = default;
+
+		bool _isPinned{true};
+	};
+
+	/**
+	 * Pin the current epoch for the calling thread.
+	 * @return Guard that unpins the epoch when destroyed.
+	 */
+	[[nodiscard]] static Guard pin() noexcept;
+
+	EpochReclaimer() = default;
+
+	/// Destroy all retired objects. Owner must make sure there are no readers left.
+	~EpochReclaimer();
+
+	EpochReclaimer(EpochReclaimer const&) = delete;
+	EpochReclaimer& operator= (EpochReclaimer const&) = delete;
+
+	/**
+	 * Retire an object that is no longer reachable by new readers.
+	 * @param destroy Function to destroy the object. It is called once no reader can observe the object.
+	 */
+	void retire(std::function<void()> destroy);
+
+	template<typename T>
+	void retire(T const* object) {
+		if constexpr (std::is_base_of<Retirable, T>::value) {
+			retire(static_cast<Retirable const*>(object), [](Retirable const* retired) noexcept {
+				delete static_cast<T const*>(retired);
+			});
+		} else {
+			retire([object]() noexcept { delete object; });
+		}
+	}
+
+	/**
+	 * Destroy retired objects that are no longer observable by any reader.
+	 * @return Number of objects destroyed.
+	 */
+	size_type collect();
+
+	/// Number of retired objects waiting to be destroyed
+	size_type pending() const;
+
+private:
+
+	/// Tag the object with the current epoch and push it to the list of retired objects
+	void retire(Retirable const* object, Retirable::Destroy destroy);
+
+	/// Push a chain of retired objects back to the list
+	void pushRetired(Retirable const* first, Retirable const* last) noexcept;
+
+	std::atomic<Retirable const*>	_retired{nullptr};	//!< Head of the list of retired objects
+	std::atomic<size_type>			_nPending{0};
+};
+
+}  // namespace kasofs
+#endif  // KASOFS_EPOCHRECLAIMER_HPP
@@ -0,0 +1,57 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		extras/lzCodec.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_EXTRAS_LZCODEC_HPP
+#define KASOFS_EXTRAS_LZCODEC_HPP
+
+#include "kasofs/fs.hpp"
+
+#include <solace/mutableMemoryView.hpp>
+
+
+namespace kasofs {
+
+/**
+ * A fast LZ77 family codec for in-memory data.
+ *
+ * Compressed data is a sequence of literal runs each followed by a back reference to previously decoded data,
+ * in a format similar to LZ4 block format. Compression is greedy with a single probe of a hash table,
+ * trading compression ratio for speed.
+ */
+struct LzCodec {
+	using size_type = Solace::MemoryView::size_type;
+
+	/// Max size of compressed data for the source of the given size.
+	static size_type compressBound(size_type srcSize) noexcept {
+		return srcSize + srcSize / 255 + 16;
+	}
+
+	/**
+	 * Compress data.
+	 * @param src Data to compress.
+	 * @param dest Buffer to write compressed data to.
+	 * @return Size of the compressed data or 0 if compressed data does not fit into the destination buffer.
+	 */
+	static size_type compress(Solace::MemoryView src, Solace::MutableMemoryView dest) noexcept;
+
+	/**
+	 * Decompress data.
+	 * @param src Compressed data.
+	 * @param dest Buffer to write decompressed data to.
+	 * @return Size of the decompressed data or an error if compressed data is malformed or does not fit.
+	 */
+	static Result<size_type> decompress(Solace::MemoryView src, Solace::MutableMemoryView dest);
+};
+
+}  // namespace kasofs
+#endif  // KASOFS_EXTRAS_LZCODEC_HPP
@@ -0,0 +1,141 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		extras/pagePool.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_EXTRAS_PAGEPOOL_HPP
+#define KASOFS_EXTRAS_PAGEPOOL_HPP
+
+#include "kasofs/fs.hpp"
+
+#include <solace/mutableMemoryView.hpp>
+
+#include <memory>
+#include <vector>
+
+
+namespace kasofs {
+
+/**
+ * Pool of fixed size memory pages with a fixed capacity.
+ *
+ * Memory is allocated in chunks of pages as the pool grows, up to the capacity of the pool.
+ * Pages never move once allocated, so a view of a page remains valid until the page is released.
+ * Pages are reference counted so that a page can be shared. A page is returned to the pool when its last reference
+ * is released. Released pages are kept in the pool and reused.
+ *
+ * Memory of the pool can be backed by a shared memory file (memfd) on Linux, so that pages can be mapped by
+ * other processes, or handed to the kernel, via the pool file descriptor. Pool falls back to the heap
+ * if the requested backing is not supported by the system.
+ */
+struct PagePool {
+	using PageId = Solace::uint32;
+	using size_type = Solace::uint32;
+
+	/// Size of a single page in bytes
+	static constexpr size_type kPageSize = 4096;
+
+	/// Number of pages allocated at once when pool grows. Chunk is the size of a 2MB huge page.
+	static constexpr size_type kPagesPerChunk = 512;
+
+	/// Memory backing the pool
+	enum class Backing {
+		Heap,			//!< Chunks are allocated on the heap
+		SharedMemory,	//!< Chunks are mapped from a memfd file
+		HugePages		//!< Chunks are mapped from a memfd file backed by huge pages
+	};
+
+	/**
+	 * Construct a new pool
+	 * @param capacity Max number of bytes pool can hold. Rounded down to the whole number of pages.
+	 * @param backing Preferred memory backing of the pool.
+	 */
+	explicit PagePool(Solace::uint64 capacity, Backing backing = Backing::Heap);
+
+	~PagePool();
+
+	PagePool(PagePool const&) = delete;
+	PagePool& operator= (PagePool const&) = delete;
+
+	PagePool(PagePool&& rhs) noexcept;
+	PagePool& operator= (PagePool&& rhs) noexcept;
+
+	/**
+	 * Allocate a page.
+	 * @return Id of the allocated page or an error if the pool is exhausted.
+	 */
+	Result<PageId> allocate();
+
+	/// Add a reference to an allocated page.
+	void share(PageId page) noexcept { _refCounts[page] += 1; }
+
+	/**
+	 * Release a reference to a page.
+	 * @return True if it was the last reference and the page is returned to the pool.
+	 */
+	bool release(PageId page);
+
+	/// Number of references to a page
+	Solace::uint32 refCount(PageId page) const noexcept { return _refCounts[page]; }
+
+	/// Get memory of a page
+	Solace::MutableMemoryView page(PageId id) const noexcept {
+		auto* chunk = _chunks[id / kPagesPerChunk].get();
+		return Solace::wrapMemory(chunk + (id % kPagesPerChunk) * kPageSize, kPageSize);
+	}
+
+	/// Actual memory backing of the pool
+	Backing backing() const noexcept { return _backing; }
+
+	/// File descriptor of the shared memory file backing the pool, or -1 if the pool is on the heap
+	int fd() const noexcept { return _fd; }
+
+	/// Offset of a page in the shared memory file backing the pool
+	Solace::uint64 fileOffset(PageId id) const noexcept { return static_cast<Solace::uint64>(id) * kPageSize; }
+
+	/// Max number of pages in the pool
+	size_type maxPages() const noexcept { return _maxPages; }
+
+	/// Number of pages allocated and not released
+	size_type pagesInUse() const noexcept { return _nextPage - static_cast<size_type>(_freePages.size()); }
+
+	/// Number of pages that can still be allocated
+	size_type pagesAvailable() const noexcept { return _maxPages - pagesInUse(); }
+
+	/// Capacity of the pool in bytes
+	Solace::uint64 capacity() const noexcept { return static_cast<Solace::uint64>(_maxPages) * kPageSize; }
+
+	/// Number of bytes held by allocated pages
+	Solace::uint64 bytesInUse() const noexcept { return static_cast<Solace::uint64>(pagesInUse()) * kPageSize; }
+
+private:
+
+	/// Releases memory of a chunk: unmaps a mapped chunk or deletes a heap one.
+	struct ChunkDeleter {
+		std::size_t	mappedSize{0};	//!< Size of the mapping, 0 for a heap chunk
+
+		void operator() (Solace::byte* chunk) const noexcept;
+	};
+
+	/// Allocate the next chunk of pages
+	Result<void> grow();
+
+	Backing									_backing;
+	int										_fd{-1};
+	size_type								_maxPages;
+	size_type								_nextPage{0};	//!< Id of the next page that has never been allocated
+	std::vector<PageId>						_freePages;
+	std::vector<Solace::uint32>				_refCounts;
+	std::vector<std::unique_ptr<Solace::byte[], ChunkDeleter>>	_chunks;
+};
+
+}  // namespace kasofs
+#endif  // KASOFS_EXTRAS_PAGEPOOL_HPP
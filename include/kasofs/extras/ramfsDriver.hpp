@@ -15,9 +15,14 @@
 #define KASOFS_RAMFS_DRIVER_HPP
 
 #include "kasofs/fs.hpp"
+#include "pagePool.hpp"
 
 #include <solace/memoryView.hpp>
+#include <solace/optional.hpp>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -26,12 +31,63 @@ namespace kasofs {
 
 /**
  * An example Virtual FS driver that exposes RAM as a filesystem.
+ * Content of files is stored in fixed size pages from a pool shared by all files of the driver.
+ * Capacity of the pool is a hard memory quota: a write that needs more memory than the quota allows
+ * evicts content of cache nodes, least recently used first, and fails if that is not enough.
+ * Sizes of nodes whose content is evicted are published to the Vfs once the IO operation that evicted them completes.
+ * Reading past the end of content of a cache node is not an error, as the content may have been evicted.
+ * Content of files that are not accessed for a while can be compressed to save memory, see RamFS::compressIdle.
+ * Compressed content is decompressed on the next read or write.
+ * Optionally, full pages with identical content are shared between files, and copied when one of the files is written.
+ * A snapshot of content of all files can be taken at any point, see RamFS::snapshot.
+ * A node can also adopt a buffer as its content without copying, see RamFS::adopt.
+ * Driver can be used from multiple threads: all operations are serialized by a single lock of the driver.
  */
 struct RamFS final : public kasofs::Filesystem {
 
+	/// Type of regular nodes. Content of a regular node is never evicted.
 	static VfsNodeType const kNodeType;
 
-	RamFS(Solace::MemoryView::size_type bufferSize) noexcept
+	/// Type of cache nodes. Content of a cache node may be dropped to make room for other writes.
+	static VfsNodeType const kCacheNodeType;
+
+	using Buffer = std::vector<Solace::byte>;
+
+	/// Mode of sharing of pages with identical content
+	enum class Deduplication {
+		Off,
+		On
+	};
+
+	struct Stats {
+		Solace::uint64	evictions{0};		//!< Number of times content of a cache node was dropped
+		Solace::uint64	bytesReclaimed{0};	//!< Number of bytes freed by evictions
+		Solace::uint64	compressions{0};	//!< Number of times content of a node was compressed
+		Solace::uint64	decompressions{0};	//!< Number of times content of a node was decompressed
+		Solace::uint64	sharedPages{0};		//!< Number of pages replaced by a shared page with the same content
+		Solace::uint64	copiesOnWrite{0};	//!< Number of shared pages copied to be written
+	};
+
+	/// Stats of the content of a single node
+	struct DataStats {
+		size_type		size{0};			//!< Size of the content
+		Solace::uint64	storedBytes{0};		//!< Number of bytes of memory used to store the content
+		bool			isCompressed{false};
+		Solace::uint32	compressions{0};
+		Solace::uint32	decompressions{0};
+	};
+
+	/**
+	 * Construct a new RAM filesystem driver
+	 * @param capacity Max number of bytes all files of the filesystem can hold.
+	 * @param deduplication Mode of sharing of pages with identical content.
+	 * @param backing Preferred memory backing of the page pool.
+	 */
+	explicit RamFS(Solace::uint64 capacity,
+				   Deduplication deduplication = Deduplication::Off,
+				   PagePool::Backing backing = PagePool::Backing::Heap)
+		: _isDedupEnabled{deduplication == Deduplication::On}
+		, _pool{capacity, backing}
 	{}
 
 	// Filesystem interface
@@ -42,6 +98,12 @@ struct RamFS final : public kasofs::Filesystem {
 
 	kasofs::Result<void> destroyNode(kasofs::INode& node) override;
 
+	size_type dataSize(kasofs::INode const& node) const override;
+
+	void bindNode(kasofs::INode const& node, kasofs::INode::Id id) override;
+
+	std::vector<kasofs::INode::Id> takeChangedNodes() override;
+
 	kasofs::Result<OpenFID>
 	open(kasofs::INode&, kasofs::Permissions) override;
 
@@ -52,6 +114,20 @@ struct RamFS final : public kasofs::Filesystem {
 	kasofs::Result<size_type>
 	write(OpenFID streamId, kasofs::INode& node, size_type offset, Solace::MemoryView src) override;
 
+	kasofs::Result<size_type>
+	readv(OpenFID streamId, kasofs::INode& node, size_type offset,
+		  Solace::ArrayView<Solace::MutableMemoryView const> dest) override;
+
+	kasofs::Result<size_type>
+	writev(OpenFID streamId, kasofs::INode& node, size_type offset,
+		   Solace::ArrayView<Solace::MemoryView const> src) override;
+
+	kasofs::Result<Solace::MemoryView>
+	borrow(OpenFID streamId, kasofs::INode& node, size_type offset, size_type size) override;
+
+	kasofs::Result<void>
+	release(OpenFID streamId, kasofs::INode const& node, Solace::MemoryView view) override;
+
 	kasofs::Result<size_type>
 	seek(OpenFID streamId, kasofs::INode& node, size_type offset, SeekDirection direction) override;
 
@@ -60,20 +136,280 @@ struct RamFS final : public kasofs::Filesystem {
 	close(OpenFID streamId, kasofs::INode& node) override;
 
 	static bool isRamNode(INode const& node) noexcept {
-		return (kNodeType == node.nodeTypeId);
+		return (kNodeType == node.nodeTypeId || kCacheNodeType == node.nodeTypeId);
 	}
 
+	/// Pool of pages storing content of all files
+	PagePool const& pool() const noexcept { return _pool; }
+
+	Stats stats() const {
+		std::lock_guard<std::mutex> lock{_mutex};
+		return _stats;
+	}
+
+	/// Get stats of the content of a node
+	Solace::Optional<DataStats> dataStats(INode const& node) const;
+
+	/**
+	 * Replace content of a node with the given buffer, without copying it.
+	 * The buffer is used as is until the node is written to, at which point it is copied into pages.
+	 * Memory of the buffer counts towards the capacity of the filesystem.
+	 * @param node Node to adopt the buffer.
+	 * @param buffer Buffer to become content of the node.
+	 * @return Error if the node is not a RAM node, content of the node is borrowed or there is not enough capacity.
+	 */
+	Result<void> adopt(INode& node, Buffer&& buffer);
+
+	/// Point-in-time image of content of all nodes of the filesystem
+	struct Snapshot;
+
+	/**
+	 * Take a snapshot of content of all nodes.
+	 * Taking a snapshot does not copy any content: content of a node is captured when the node is about to change,
+	 * and only the pages that are written to afterwards are copied.
+	 * @note Snapshot must not outlive the filesystem.
+	 * @return Snapshot of the current content.
+	 */
+	Snapshot snapshot();
+
+	/**
+	 * Get offsets of pages of the node content in the shared memory file backing the page pool.
+	 * Pages can be mapped with mmap(2) using the pool file descriptor, see PagePool::fd.
+	 * @note Offsets are only valid until the node is written to or destroyed, as pages of the node may change.
+	 * @return Offsets of pages in the order of the node content or an error if the pool is not backed by a file.
+	 */
+	Result<std::vector<Solace::uint64>> pageOffsets(INode& node);
+
+	/**
+	 * Compress content of nodes that have not been accessed for a while.
+	 * It is up to the user to call this method periodically, off the IO path, for example from an idle timer.
+	 * Content is kept as is unless compression saves at least a page of memory.
+	 * @param maxIdleSeconds Number of seconds since the last access for a node to be compressed.
+	 * @return Number of nodes compressed.
+	 */
+	Solace::uint32 compressIdle(Solace::uint32 maxIdleSeconds);
+
 protected:
 	using DataId = kasofs::INode::VfsData;
-	using Buffer = std::vector<Solace::byte>;
+
+	/// 128 bit hash of the content of a page
+	struct PageHash {
+		Solace::uint64	low;
+		Solace::uint64	high;
+
+		bool operator== (PageHash const& rhs) const noexcept {
+			return low == rhs.low && high == rhs.high;
+		}
+
+		struct Hasher {
+			std::size_t operator() (PageHash const& hash) const noexcept { return hash.low; }
+		};
+	};
+
+	struct SnapshotImage;
+
+	/// View of data borrowed by an open file
+	struct Borrow {
+		OpenFID				fid;
+		Solace::byte const*	address;	//!< Start of the borrowed view
+	};
+
+	/// Content of a file: pages in the order of file offset.
+	struct FileData {
+		std::vector<PagePool::PageId>	pages;
+		size_type						size{0};
+		size_type						compressedSize{0};	//!< Size of compressed content in pages, 0 if not compressed
+		std::vector<Borrow>				borrows;	//!< Views of the data borrowed and not yet released
+		std::vector<PagePool::PageId>	retired;	//!< Pages replaced while views of the data are borrowed
+		Solace::uint32					accessTime{0};	//!< Time of the last access to the data
+		FileData*						newer{nullptr};	//!< More recently used evictable data
+		FileData*						older{nullptr};	//!< Less recently used evictable data
+		Solace::uint32					compressions{0};
+		Solace::uint32					decompressions{0};
+		bool							isEvictable{false};
+		std::vector<std::weak_ptr<SnapshotImage>>	snapshots;	//!< Images of snapshots yet to capture the data
+		std::shared_ptr<Buffer const>	adopted;	//!< Adopted buffer holding content instead of pages
+		std::shared_ptr<Buffer const>	retiredAdopted;	//!< Adopted buffer replaced while views are borrowed
+		Solace::Optional<INode::Id>		nodeId;		//!< Id of the node of the data in the Vfs, once known
+
+		bool isCompressed() const noexcept { return compressedSize != 0; }
+
+		/// Test if any view of the data is borrowed
+		bool isPinned() const noexcept { return !borrows.empty(); }
+
+		/// Number of bytes stored in pages
+		size_type storedSize() const noexcept { return isCompressed() ? compressedSize : size; }
+	};
+
+	/// Content of a file as it was when a snapshot was taken
+	struct SnapshotImage {
+		bool		isCaptured{false};	//!< If false, content has not changed since and is read from the file
+		FileData	data;
+		Buffer		content;	//!< Decompressed content, kept once compressed content is read from the snapshot
+	};
+
+	/// Capture the data in snapshot images waiting for it to change
+	void capture(FileData& data);
+
+	/// Test if any snapshot is yet to capture the data
+	static bool hasPendingSnapshots(FileData const& data) noexcept;
 
 	DataId nextId() noexcept { return _idBase++; }
 
+	/// Find data of a node and mark it as recently used.
+	FileData* findData(INode& node) noexcept;
+
+	FileData const* findData(INode const& node) const noexcept {
+		auto it = _dataStore.find(node.vfsData);
+		return (it == _dataStore.end())
+				? nullptr
+				: &it->second;
+	}
+
+	FileData* findData(INode const& node) noexcept {
+		auto it = _dataStore.find(node.vfsData);
+		return (it == _dataStore.end())
+				? nullptr
+				: &it->second;
+	}
+
+	/// Compress content of the data if that saves memory.
+	bool compress(FileData& data);
+
+	/// Make sure content of the data is not compressed.
+	Result<void> decompress(FileData& data);
+
+	/// Decompress content of the data into a buffer, leaving the data as is.
+	Result<Buffer> decompressedContent(FileData const& data) const;
+
+	/// Make sure content of the data is stored in pages rather than in an adopted buffer.
+	Result<void> materialize(FileData& data);
+
+	/// Number of pages that can be allocated without exceeding the capacity, taking buffers outside of the pool into account
+	Solace::uint64 pagesAvailable() const noexcept {
+		auto const nAvailable = _pool.pagesAvailable();
+		return (nAvailable > _adoptedPages) ? nAvailable - _adoptedPages : 0;
+	}
+
+	/// Number of pages worth of memory required to hold the given number of bytes
+	static Solace::uint64 pagesFor(Solace::uint64 size) noexcept {
+		return (size + PagePool::kPageSize - 1) / PagePool::kPageSize;
+	}
+
+	/// Move evictable data to the most recently used end of the eviction list
+	void touch(FileData& data) noexcept;
+
+	/// Remove data from the eviction list
+	void unlink(FileData& data) noexcept;
+
+	/**
+	 * Drop content of least recently used cache nodes until the given number of pages is available.
+	 * @param nPages Number of pages required.
+	 * @param exclude Data that must not be evicted.
+	 * @return True if the pool has the required number of pages available.
+	 */
+	bool evict(Solace::uint64 nPages, FileData const* exclude);
+
+	/**
+	 * Make sure data has enough pages to hold the given number of bytes.
+	 * @param size Number of bytes the data must hold.
+	 * @param writeOffset Offset the caller is about to write from, up to the size. New pages are zeroed outside that range.
+	 */
+	Result<void> reserve(FileData& data, Solace::uint64 size, Solace::uint64 writeOffset = 0);
+
+	/// Make sure pages of the given range of the data have enough pages and none of them is shared.
+	Result<void> prepareWrite(FileData& data, Solace::uint64 offset, Solace::uint64 size);
+
+	/// Share full pages of the given range of the data with pages of the same content.
+	void deduplicate(FileData& data, Solace::uint64 offset, Solace::uint64 size);
+
+	/// Release a reference to a page, once the data has no borrowed views.
+	void retire(FileData& data, PagePool::PageId page);
+
+	/// Release pages and the buffer retired while views of the data were borrowed, once no view is borrowed.
+	void releaseRetired(FileData& data);
+
+	/**
+	 * Release a reference to a page.
+	 * @return True if the page is returned to the pool.
+	 */
+	bool releasePage(PagePool::PageId page);
+
+	/// Copy stored bytes starting at the given offset into the destination buffer.
+	size_type copyOut(FileData const& data, size_type offset, Solace::MutableMemoryView dest) const noexcept;
+
+	/// Copy source buffer into the pages at the given offset. Data must have enough pages reserved.
+	void copyIn(FileData& data, size_type offset, Solace::MemoryView src) noexcept;
+
+	/**
+	 * Release all pages of the data.
+	 * @return Number of pages returned to the pool.
+	 */
+	Solace::uint64 releasePages(FileData& data);
+
 private:
+	mutable std::mutex					_mutex;		//!< Guards all the state of the driver
+	bool								_isDedupEnabled;
 	DataId								_idBase{0};
-	std::unordered_map<DataId, Buffer>	_dataStore;
+	OpenFID								_nextFid{0};
+	FileData*							_mostRecent{nullptr};	//!< Head of the eviction list of cache nodes data
+	FileData*							_leastRecent{nullptr};	//!< Tail of the eviction list, evicted first
+	std::vector<INode::Id>				_changedNodes;	//!< Nodes whose content has been evicted since last reported
+	std::atomic<bool>					_hasChangedNodes{false};	//!< Lets IO skip the lock if nothing is to report
+	Solace::uint64						_adoptedPages{0};	//!< Capacity taken by buffers outside of the pool, in pages
+	Stats								_stats;
+	PagePool							_pool;
+	std::unordered_map<DataId, FileData>	_dataStore;
+	std::unordered_map<PageHash, PagePool::PageId, PageHash::Hasher>	_pageIndex;	//!< Pages that can be shared
+	std::unordered_map<PagePool::PageId, PageHash>	_indexedPages;
 };
 
 
+
+/**
+ * Point-in-time image of content of all nodes of a RamFS.
+ * Content of nodes created after the snapshot was taken is not in the snapshot.
+ */
+struct RamFS::Snapshot {
+
+	~Snapshot();
+
+	Snapshot(Snapshot const&) = delete;
+	Snapshot& operator= (Snapshot const&) = delete;
+
+	Snapshot(Snapshot&& rhs) noexcept;
+	Snapshot& operator= (Snapshot&& rhs) noexcept;
+
+	/// Get size of content of a node at the time of the snapshot
+	Solace::Optional<size_type> size(INode const& node) const;
+
+	/**
+	 * Read content of a node as it was at the time of the snapshot.
+	 * Compressed content is decompressed on the first read and kept, counting towards capacity, until the snapshot
+	 * is released.
+	 * @param node Node to read.
+	 * @param offset Offset to start reading from.
+	 * @param dest Buffer to read data into.
+	 * @return Number of bytes read or an error.
+	 */
+	Result<size_type> read(INode const& node, size_type offset, Solace::MutableMemoryView dest) const;
+
+private:
+	friend struct RamFS;
+
+	explicit Snapshot(RamFS* fs) noexcept
+		: _fs{fs}
+	{}
+
+	/// Get data of a node as it was at the time of the snapshot
+	FileData const* findData(INode const& node) const;
+
+	/// Release pages captured by the snapshot
+	void release() noexcept;
+
+	RamFS*		_fs;
+	std::unordered_map<DataId, std::shared_ptr<SnapshotImage>>	_images;
+};
+
 }  // namespace kasofs
 #endif  // KASOFS_RAMFS_DRIVER_HPP
@@ -16,30 +16,80 @@
 
 #include "fs.hpp"
 
+#include <solace/optional.hpp>
+
+#include <mutex>
+
 
 namespace kasofs {
 
+/**
+ * Policy of updating node metadata by IO operations of an open file.
+ */
+struct MetadataPolicy {
+
+	/// When changes to node metadata made by IO operations are published to the index
+	enum class Sync {
+		WriteThrough,	//!< Every IO operation modifies the node in the index.
+		WriteBack		//!< IO operations modify a private copy of the node, published on flush or close.
+	};
+
+	/// When access time of the node is updated by reads
+	enum class AccessTime {
+		Strict,			//!< Every read updates access time.
+		Relative,		//!< Read updates access time if it is older than modification time or older than a day.
+		None			//!< Reads never update access time.
+	};
+
+	/// Max age of access time before it is updated by a read under Relative policy, in seconds.
+	static constexpr Solace::uint32 kRelativeAccessTimeAge = 24 * 60 * 60;
+
+	constexpr MetadataPolicy() noexcept = default;
+
+	constexpr MetadataPolicy(Sync syncMode, AccessTime atimeMode) noexcept
+		: sync{syncMode}
+		, atime{atimeMode}
+	{}
+
+	Sync		sync{Sync::WriteThrough};
+	AccessTime	atime{AccessTime::None};
+};
+
+
 /**
  * A file-like object.
+ * Depending on the metadata policy the file was opened with, IO operations either access the node
+ * in the index of the Vfs in place, or work with a private copy of the node that is published on flush and close.
+ * A file can be shared by threads for positional reads: the private copy of the node is guarded by the file's own lock.
  */
 struct File {
 	using size_type = Filesystem::size_type;
 
 	~File();
 
-	constexpr File(struct Vfs* fs, INode::Id nodeId, INode node, Filesystem::OpenFID openId) noexcept
-		: _vfs{fs}
+	File(struct Vfs* vfs, INode::Id nodeId, INode const& node, Filesystem* fs, Filesystem::OpenFID openId,
+		 MetadataPolicy policy) noexcept
+		: _vfs{vfs}
+		, _fs{fs}
 		, _fid{openId}
 		, _nodeId{nodeId}
-		, _cachedNode{node}
+		, _fsTypeId{node.fsTypeId}
+		, _policy{policy}
+		, _privateNode{node}
 	{}
 
-	constexpr File(File&& rhs) noexcept
+	File(File&& rhs) noexcept
 		: _vfs{Solace::exchange(rhs._vfs, nullptr)}
+		, _fs{rhs._fs}
 		, _fid{Solace::exchange(rhs._fid, -1)}
 		, _nodeId{rhs._nodeId}
-		, _cachedNode{rhs._cachedNode}
-	{}
+		, _fsTypeId{rhs._fsTypeId}
+		, _policy{rhs._policy}
+		, _privateNode{rhs._privateNode}
+		, _isDirty{Solace::exchange(rhs._isDirty, false)}
+		, _readOffset{rhs._readOffset}
+		, _writeOffset{rhs._writeOffset}
+	{}  // Lock is not moved: a file can not be moved while other threads use it
 
 	File& operator= (File&& rhs) noexcept {
 		return swap(rhs);
@@ -48,9 +98,13 @@ struct File {
 	File& swap(File& rhs) noexcept {
 		using std::swap;
 		swap(_vfs, rhs._vfs);
+		swap(_fs, rhs._fs);
 		swap(_fid, rhs._fid);
 		swap(_nodeId, rhs._nodeId);
-		swap(_cachedNode, rhs._cachedNode);
+		swap(_fsTypeId, rhs._fsTypeId);
+		swap(_policy, rhs._policy);
+		swap(_privateNode, rhs._privateNode);
+		swap(_isDirty, rhs._isDirty);
 
 		swap(_readOffset, rhs._readOffset);
 		swap(_writeOffset, rhs._writeOffset);
@@ -68,22 +122,92 @@ struct File {
 	Result<size_type>
 	read(Solace::MutableMemoryView dest);
 
+	/**
+	 * Read data at the given offset. Read position of the file is not used nor changed.
+	 * @param offset Offset in the file to read data from.
+	 * @param dest Buffer to read data into.
+	 * @return Number of bytes read.
+	 */
+	Result<size_type>
+	readAt(size_type offset, Solace::MutableMemoryView dest);
+
+	/**
+	 * Write data at the given offset. Write position of the file is not used nor changed.
+	 * @param offset Offset in the file to write data at.
+	 * @param src Data to write.
+	 * @return Number of bytes written.
+	 */
+	Result<size_type>
+	writeAt(size_type offset, Solace::MemoryView src);
+
 	Result<size_type>
 	write(Solace::MemoryView src);
 
+	/**
+	 * Read data into a sequence of buffers with a single driver call.
+	 * @return Total number of bytes read.
+	 */
+	Result<size_type>
+	readv(Solace::ArrayView<Solace::MutableMemoryView const> dest);
+
+	/**
+	 * Write data from a sequence of buffers with a single driver call.
+	 * @return Total number of bytes written.
+	 */
+	Result<size_type>
+	writev(Solace::ArrayView<Solace::MemoryView const> src);
+
+	/**
+	 * Read data without copying it: borrow a view of the data from the driver storage.
+	 * Read position is advanced by the size of the borrowed view, which may be shorter than requested.
+	 * @param size Max number of bytes to borrow.
+	 * @return View of the file data that must be released with releaseBorrowed before the file is closed.
+	 */
+	Result<Solace::MemoryView>
+	readBorrowed(size_type size);
+
+	/// Release a view of the file data borrowed with readBorrowed.
+	Result<void>
+	releaseBorrowed(Solace::MemoryView view);
+
 	Result<INode> stat() const noexcept;
 
+	/// Publish changes to node metadata made by IO operations, if the file was opened in write-back mode.
 	void flush();
 
+	/// Metadata policy the file was opened with
+	MetadataPolicy const& metadataPolicy() const noexcept { return _policy; }
+
 	Result<INode::size_type> size() const noexcept {
 		return stat().then([](INode const& node) { return node.dataSize; });
 	}
 
 private:
+
+	/// Run an IO operation against the node, as dictated by the sync policy
+	template<typename F>
+	auto withNodeForIO(F&& f);
+
+	/**
+	 * Run a read operation against a snapshot of the node that is not modified by the operation.
+	 * Access time, if changed by the read, is published as dictated by the sync policy.
+	 */
+	template<typename F>
+	auto withNodeForRead(F&& f);
+
+	/// Update access time of the node after a read, as dictated by the access time policy
+	/// @return True if access time of the node has been changed.
+	bool touchAccessTime(INode& node) const noexcept;
+
 	struct Vfs*				_vfs;
+	Filesystem*				_fs;		//!< Driver of the file, resolved once when the file is opened
 	Filesystem::OpenFID		_fid;
 	INode::Id				_nodeId;
-	INode					_cachedNode;
+	VfsId					_fsTypeId;
+	MetadataPolicy			_policy;
+	INode					_privateNode;	//!< Copy of the node used in write-back mode
+	bool					_isDirty{false};	//!< True if the private copy of the node has unpublished changes
+	mutable std::mutex		_lock;		//!< Guards the private copy of the node when the file is shared by threads
 
 	size_type				_readOffset{0};
 	size_type				_writeOffset{0};
@@ -19,6 +19,9 @@
 #include <solace/result.hpp>
 #include <solace/error.hpp>
 #include <solace/mutableMemoryView.hpp>
+#include <solace/arrayView.hpp>
+
+#include <vector>
 
 
 namespace kasofs {
@@ -49,12 +52,63 @@ struct Filesystem {
 	virtual auto createNode(NodeType type, User owner, FilePermissions perms) -> Result<INode> = 0;
 	virtual auto destroyNode(INode& node) -> Result<void> = 0;
 
+	/**
+	 * Get current size of data of a node.
+	 * A driver that changes data on its own, for example drops it to reclaim memory, reports the actual size here
+	 * as the size recorded in a copy of the node may be out of date.
+	 * Default implementation returns the size recorded in the node.
+	 */
+	virtual auto dataSize(INode const& node) const -> size_type;
+
+	/**
+	 * Tell the driver the id a node it created has in the Vfs, so that the driver can report the node
+	 * when it changes the node data on its own, see takeChangedNodes.
+	 * Default implementation ignores it.
+	 */
+	virtual void bindNode(INode const& node, INode::Id id);
+
+	/**
+	 * Take ids of nodes whose data the driver changed on its own since the last call.
+	 * Vfs publishes the current size of data of such nodes, see dataSize, once it holds no locks.
+	 * Default implementation reports no nodes.
+	 */
+	virtual auto takeChangedNodes() -> std::vector<INode::Id>;
+
 	virtual auto open(INode& node, Permissions op) -> Result<OpenFID> = 0;
 
 	virtual auto read(OpenFID fid, INode& node, size_type off, Solace::MutableMemoryView dest) ->Result<size_type> = 0;
 
 	virtual auto write(OpenFID fid, INode& node, size_type offset, Solace::MemoryView src) -> Result<size_type> = 0;
 
+	/**
+	 * Scatter read: read data starting at the given offset into a sequence of buffers, filling each buffer in turn.
+	 * Default implementation reads into each buffer in turn until a read comes short.
+	 * @return Total number of bytes read or an error if nothing could be read.
+	 */
+	virtual auto readv(OpenFID fid, INode& node, size_type offset,
+					   Solace::ArrayView<Solace::MutableMemoryView const> dest) -> Result<size_type>;
+
+	/**
+	 * Gather write: write data from a sequence of buffers, as if they were one contiguous buffer, at the given offset.
+	 * Default implementation writes each buffer in turn until a write comes short.
+	 * @return Total number of bytes written or an error if nothing could be written.
+	 */
+	virtual auto writev(OpenFID fid, INode& node, size_type offset,
+						Solace::ArrayView<Solace::MemoryView const> src) -> Result<size_type>;
+
+	/**
+	 * Borrow a view of file data directly from the driver storage, avoiding a copy.
+	 * Borrowed view remains valid until it is released. View may be shorter than requested.
+	 * Default implementation does not support borrowing and returns an error.
+	 * @return View of up to size bytes of file data starting at the given offset.
+	 */
+	virtual auto borrow(OpenFID fid, INode& node, size_type offset, size_type size) -> Result<Solace::MemoryView>;
+
+	/**
+	 * Release a view previously borrowed with borrow.
+	 */
+	virtual auto release(OpenFID fid, INode const& node, Solace::MemoryView view) -> Result<void>;
+
 	virtual auto seek(OpenFID fid, INode& node, size_type offset, SeekDirection direction) -> Result<size_type> = 0;
 
 	virtual auto close(OpenFID fid, INode& node) -> Result<void> = 0;
@@ -0,0 +1,139 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		namePool.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_NAMEPOOL_HPP
+#define KASOFS_NAMEPOOL_HPP
+
+#include <solace/types.hpp>
+#include <solace/stringView.hpp>
+#include <solace/optional.hpp>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+namespace kasofs {
+
+/**
+ * Name along with its hash.
+ * The hash is computed once when the key is made, so that a lookup by a name does not need to allocate a temporary
+ * string and every operation hashes the name only once.
+ */
+struct EntryName {
+	struct Hash {
+		std::size_t operator() (EntryName const& key) const noexcept { return key.hash; }
+	};
+
+	struct Equal {
+		bool operator() (EntryName const& lhs, EntryName const& rhs) const noexcept {
+			return (lhs.hash == rhs.hash) && lhs.name.equals(rhs.name);
+		}
+	};
+
+	explicit EntryName(Solace::StringView n) noexcept
+		: name{n}
+		, hash{hashOf(n)}
+	{}
+
+	static std::size_t hashOf(Solace::StringView name) noexcept;
+
+	Solace::StringView  name;	//!< View of the name.
+	std::size_t			hash;	//!< Hash of the name.
+};
+
+
+/**
+ * Pool of interned directory entry names.
+ *
+ * Names are copied into an arena of fixed size blocks so that views of interned names remain valid as the pool grows.
+ * Identical names are stored once and reference counted: each interned name is identified by a compact handle.
+ * Memory of a name is recycled for a new name of the same length once all references to it are released.
+ */
+struct NamePool {
+	using Handle = Solace::uint32;
+	using size_type = Solace::uint32;
+
+	/// Size of a block of the arena. Names that are longer than a block get a dedicated allocation.
+	static constexpr size_type kBlockSize = 16 * 1024;
+
+	NamePool() = default;
+
+	NamePool(NamePool const&) = delete;
+	NamePool& operator= (NamePool const&) = delete;
+
+	NamePool(NamePool&&) = default;
+	NamePool& operator= (NamePool&&) = default;
+
+	/**
+	 * Intern a name, adding a reference to it.
+	 * @param name Name to intern.
+	 * @return Handle of the interned name.
+	 */
+	Handle intern(Solace::StringView name);
+
+	/**
+	 * Find a handle of a previously interned name. No reference is added.
+	 * @param name Name to search for.
+	 * @return Handle of the name if it is interned, none otherwise.
+	 */
+	Solace::Optional<Handle> find(Solace::StringView name) const noexcept;
+
+	/**
+	 * Release a reference to an interned name.
+	 * @param handle Handle of the name to release.
+	 */
+	void release(Handle handle);
+
+	/// Get a view of the interned name. View remains valid until the last reference to the name is released.
+	Solace::StringView name(Handle handle) const noexcept {
+		auto const& record = _records[handle];
+		return Solace::StringView{record.data, record.size};
+	}
+
+	/// Number of unique names in the pool
+	size_type size() const noexcept { return static_cast<size_type>(_index.size()); }
+
+	/// Number of bytes allocated for the arena
+	Solace::uint64 capacity() const noexcept { return _bytesAllocated; }
+
+private:
+
+	struct Record {
+		char*						data;
+		Solace::StringView::size_type size;
+		Solace::uint32				refCount;
+	};
+
+	char* allocate(Solace::StringView::size_type size);
+
+	/// Interned names: one record per handle
+	std::vector<Record>								_records;
+	std::vector<Handle>								_freeHandles;
+
+	/// Index of names to handles
+	std::unordered_map<EntryName, Handle, EntryName::Hash, EntryName::Equal>	_index;
+
+	/// Arena blocks
+	std::vector<std::unique_ptr<char[]>>			_blocks;
+	char*											_block{nullptr};			//!< Block being filled
+	size_type										_blockOffset{kBlockSize};	//!< Offset of free space in the block
+	Solace::uint64									_bytesAllocated{0};
+
+	/// Storage of released names, by length, to be reused for new names of the same length.
+	std::unordered_map<Solace::StringView::size_type, std::vector<char*>>	_freeStorage;
+};
+
+
+}  // namespace kasofs
+#endif  // KASOFS_NAMEPOOL_HPP
@@ -0,0 +1,167 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS: Virtual filesystem
+ *	@file		pathSegments.hpp
+ ******************************************************************************/
+#pragma once
+#ifndef KASOFS_PATHSEGMENTS_HPP
+#define KASOFS_PATHSEGMENTS_HPP
+
+#include <solace/types.hpp>
+#include <solace/stringView.hpp>
+
+#include <array>
+#include <iterator>
+
+
+namespace kasofs {
+
+/**
+ * Segments of a path string, such as "a/b/c", split in place.
+ * No memory is allocated: segments are views into the path string and are tokenized as the path is iterated.
+ * Empty segments, as in "/a//b/", are skipped.
+ */
+struct PathSegments {
+	static constexpr char kDelimiter = '/';
+
+	struct Iterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Solace::StringView;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Solace::StringView const*;
+		using reference = Solace::StringView;
+
+		Iterator(char const* position, char const* end) noexcept
+			: _end{end}
+		{
+			seek(position);
+		}
+
+		Solace::StringView operator* () const noexcept {
+			return Solace::StringView{_position, static_cast<Solace::StringView::size_type>(_segmentEnd - _position)};
+		}
+
+		Iterator& operator++ () noexcept {
+			seek(_segmentEnd);
+			return *this;
+		}
+
+		bool operator== (Iterator const& rhs) const noexcept { return _position == rhs._position; }
+		bool operator!= (Iterator const& rhs) const noexcept { return _position != rhs._position; }
+
+	private:
+
+		void seek(char const* from) noexcept {
+			while (from != _end && *from == kDelimiter) {
+				++from;
+			}
+
+			_position = from;
+			_segmentEnd = from;
+			while (_segmentEnd != _end && *_segmentEnd != kDelimiter) {
+				++_segmentEnd;
+			}
+		}
+
+		char const*	_position;
+		char const*	_segmentEnd;
+		char const*	_end;
+	};
+
+	explicit PathSegments(Solace::StringView path) noexcept
+		: _path{path}
+	{}
+
+	Iterator begin() const noexcept { return {_path.data(), _path.data() + _path.size()}; }
+	Iterator end() const noexcept { return {_path.data() + _path.size(), _path.data() + _path.size()}; }
+
+	/// Test if the path has no segments
+	bool empty() const noexcept { return !(begin() != end()); }
+
+private:
+	Solace::StringView	_path;
+};
+
+
+/**
+ * Path literal split into segments at compile time.
+ * Useful for hard-coded paths that are resolved often:
+ * ```
+ * constexpr StaticPath kConfigPath{"etc/app/config"};
+ * vfs.walk(user, vfs.rootId(), kConfigPath);
+ * ```
+ */
+template<std::size_t N>
+struct StaticPath {
+	/// Max number of segments a path of the given size can have
+	static constexpr std::size_t kMaxSegments = N / 2 + 1;
+
+	struct Segment {
+		std::size_t	offset{0};
+		std::size_t	length{0};
+	};
+
+	struct Iterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Solace::StringView;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Solace::StringView const*;
+		using reference = Solace::StringView;
+
+		Solace::StringView operator* () const noexcept {
+			return Solace::StringView{_path->_chars.data() + _segment->offset,
+									  static_cast<Solace::StringView::size_type>(_segment->length)};
+		}
+
+		Iterator& operator++ () noexcept {
+			++_segment;
+			return *this;
+		}
+
+		bool operator== (Iterator const& rhs) const noexcept { return _segment == rhs._segment; }
+		bool operator!= (Iterator const& rhs) const noexcept { return _segment != rhs._segment; }
+
+		StaticPath const*	_path;
+		Segment const*		_segment;
+	};
+
+	constexpr StaticPath(char const (&path)[N]) noexcept {
+		std::size_t segmentStart = 0;
+		for (std::size_t i = 0; i < N; ++i) {
+			_chars[i] = path[i];
+
+			if (path[i] == PathSegments::kDelimiter || path[i] == 0) {
+				if (i > segmentStart) {
+					_segments[_size].offset = segmentStart;
+					_segments[_size].length = i - segmentStart;
+					_size += 1;
+				}
+				segmentStart = i + 1;
+			}
+		}
+	}
+
+	/// Number of segments in the path
+	constexpr std::size_t size() const noexcept { return _size; }
+
+	/// Test if the path has no segments
+	constexpr bool empty() const noexcept { return _size == 0; }
+
+	Iterator begin() const noexcept { return {this, _segments.data()}; }
+	Iterator end() const noexcept { return {this, _segments.data() + _size}; }
+
+private:
+	std::array<char, N>					_chars{};
+	std::array<Segment, kMaxSegments>	_segments{};
+	std::size_t							_size{0};
+};
+
+}  // namespace kasofs
+#endif  // KASOFS_PATHSEGMENTS_HPP
@@ -17,6 +17,10 @@
 #include "vinode.hpp"
 #include "fs.hpp"
 #include "directoryDriver.hpp"
+#include "dentryCache.hpp"
+#include "chunkedArray.hpp"
+#include "epochReclaimer.hpp"
+#include "pathSegments.hpp"
 #include "file.hpp"
 
 
@@ -25,8 +29,18 @@
 #include <solace/posixErrorDomain.hpp>
 #include <solace/path.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>  // memcpy
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <unordered_map>
 
 
 namespace kasofs {
@@ -73,6 +87,23 @@ namespace kasofs {
  * # Note: link is directory's write
  * ```
  *
+ * VFS can be used from multiple threads concurrently. Nodes are modified under a set of reader/writer locks
+ * striped by node index: link, unlink and mknode lock exclusively only the directory and the node they modify.
+ * Reads of nodes and directories, such as nodeById, walk and walkMany, take no locks at all: slots of the inode table
+ * never move, and a writer publishes a copy of the node that readers read optimistically, retrying if it changes
+ * underneath them. Removed entries of directories are reclaimed once no reader pinned with EpochReclaimer::pin
+ * can observe them.
+ * Driver registry is guarded by a registry lock, taken by operations that use a driver. Walks use the dentry cache
+ * without the registry lock: a disabled cache is reclaimed once no pinned reader can observe it.
+ * Locks are always taken in the same order: the registry lock, then locks of nodes in the order of their stripe,
+ * so that no two operations can deadlock.
+ * Note: Callbacks given to walk are invoked with a copy of a node and no locks held.
+ *
+ * Every modification of the namespace is stamped with a new version. Vfs::snapshot takes an immutable view of
+ * the namespace at the current version without copying anything: while snapshots exist, writers retain
+ * the states of nodes and the directory entries they replace, so memory used by snapshots is proportional
+ * to the changes made since they were taken. Retained states no longer visible to any snapshot are destroyed
+ * by Vfs::reclaim.
  */
 struct Vfs {
 	static Solace::StringLiteral const kThisDir;
@@ -80,6 +111,12 @@ struct Vfs {
 
     using size_type = std::vector<INode>::size_type;
 
+	/// Version of the namespace
+	using Version = DirectoryEntries::Version;
+
+	/// Immutable view of the namespace at a point in time
+	struct Snapshot;
+
     /**
      * Descriptor of a mounted vfs
      */
@@ -115,12 +152,52 @@ public:
 	 * @return Number of nodes in the index
 	 */
 	size_type size() const noexcept {
-		return _index.size();
+		std::lock_guard<std::mutex> slots{_locks->slots};
+
+		return _nodeCount;
+	}
+
+	/// Stats of reclamation of unlinked nodes
+	struct ReclaimStats {
+		size_type		pending{0};		//!< Number of nodes waiting to be destroyed
+		Solace::uint64	reclaimed{0};	//!< Number of nodes destroyed
+		Solace::uint64	failed{0};		//!< Number of nodes a driver failed to destroy. Slots of such nodes are reused.
+	};
+
+	/// Default number of nodes to destroy per call to Vfs::reclaim
+	static constexpr size_type kReclaimBatchSize = 64;
+
+	ReclaimStats reclaimStats() const noexcept {
+		std::lock_guard<std::mutex> slots{_locks->slots};
+
+		ReclaimStats stats = _reclaimStats;
+		stats.pending = static_cast<size_type>(_reclaimQueue.size());
+
+		return stats;
 	}
 
+	/**
+	 * Destroy nodes that have been unlinked and are no longer open.
+	 * Such nodes are queued rather than destroyed as soon as the last link is removed,
+	 * so that the cost of destroying them can be paid off the hot path, in batches.
+	 * A slot of a node is reused only after the node has been destroyed.
+	 * Removed directory entries that are no longer observable by readers are destroyed too.
+	 * @param maxNodes Max number of nodes to destroy.
+	 * @return Number of nodes destroyed, not counting nodes a driver failed to destroy.
+	 */
+	size_type reclaim(size_type maxNodes = kReclaimBatchSize);
+
+
+	/**
+	 * Take a snapshot of the namespace: a consistent view of all nodes and directories as they are now,
+	 * that is not affected by modifications made afterwards. Nothing is copied to take a snapshot.
+	 * @return Snapshot of the namespace at the current version.
+	 * @note Snapshot must not outlive this Vfs, and the Vfs must not be moved while it has snapshots.
+	 */
+	Snapshot snapshot();
 
 	/**
-	 * Find an inode by node Id. Equivalent to FS stat call
+	 * Find an inode by node Id. Equivalent to FS stat call. Lock-free.
 	 * @param id inode number.
 	 * @return Optional INode if given inode was found, none otherwise.
 	 */
@@ -135,6 +212,37 @@ public:
 	Result<void>
 	updateNode(INode::Id id, INode inode);
 
+	/**
+	 * Access a node in place, without copying it out of the index.
+	 * @param id Id of the node to access.
+	 * @param f Function to invoke with a const reference to the node.
+	 * @return Value returned by the function, or none if there is no node with the given Id.
+	 * @note Reference to the node must not be retained as the slot is reused once the node is destroyed.
+	 * @note Function is invoked with the node locked for reading and must not call back into this Vfs.
+	 */
+	template<typename F>
+	auto withNode(INode::Id id, F&& f) const {
+		std::shared_lock<std::shared_mutex> node{nodeLock(id.index)};
+
+		return visitEntry(entryById(id), std::forward<F>(f));
+	}
+
+	/**
+	 * Modify a node in place. Version of the node is bumped once modification is done.
+	 * @param id Id of the node to modify.
+	 * @param f Function to invoke with a reference to the node.
+	 * @return Value returned by the function, or none if there is no node with the given Id.
+	 * @note Function must not change type of the node or call back into this Vfs.
+	 */
+	template<typename F>
+	auto modifyNode(INode::Id id, F&& f) {
+		auto modification = beginModification();
+		std::unique_lock<std::shared_mutex> node{nodeLock(id.index)};
+		assignVersion(modification);
+
+		return modifyEntry(entryById(id), id.index, modification, std::forward<F>(f));
+	}
+
 
     /////////////////////////////////////////////////////////////
     /// VFS management
@@ -148,9 +256,9 @@ public:
 	Result<VfsId> registerFilesystem(Args&& ...args) {
 		auto fs = std::make_unique<Type>(std::forward<Args>(args)...);
 
-		const auto regId = _nextId;
-		_vfs.emplace(regId, std::move(fs));
-		_nextId += 1;
+		std::unique_lock<std::shared_mutex> registry{_locks->registry};
+		auto const regId = static_cast<VfsId>(_drivers.size());
+		_drivers.emplace_back(std::move(fs));
 
 		return Solace::Ok(regId);
 	}
@@ -161,16 +269,29 @@ public:
 	 * @return Id of the registered vfs or an error.
 	 */
 	Solace::Optional<Filesystem*>
-	findFs(VfsId id) const noexcept;
+	findFs(VfsId id) const noexcept {
+		std::shared_lock<std::shared_mutex> registry{_locks->registry};
+
+		return driverOf(id);
+	}
 
 	/**
 	 * Un-Register previously registered vFS
 	 * @param VfsId Id of the previously registered vfs
-	 * @return Void or an error.
+	 * @return Void or an error. It is an error to unregister a vfs while there are files open through it.
 	 */
 	Result<void>
 	unregisterFileSystem(VfsId VfsId);
 
+	/**
+	 * Set metadata policy used by default for files opened through the given vfs.
+	 * @param fsId Id of the previously registered vfs.
+	 * @param policy Metadata policy for files opened without an explicit policy.
+	 * @return Void or an error.
+	 */
+	Result<void>
+	setMetadataPolicy(VfsId fsId, MetadataPolicy policy);
+
 	/**
 	 * Mount registered vfs to a given mount point.
 	 * @param user User credentials to perform the operation as.
@@ -223,47 +344,107 @@ public:
 	unlink(User user, INode::Id from, Solace::StringView name);
 
 
+	/**
+	 * Resolve a path starting from the given node, invoking a callback for every node resolved on the way.
+	 * Path segments "." and ".." refer to the current and the parent directory respectively.
+	 * Walk can not go above the node it started from: ".." of the start node is the start node itself.
+	 * @param user User performing the walk. User must have read permission for every directory on the path.
+	 * @param rootId Id of the node to start the walk from.
+	 * @param path Path to resolve: any range of path segments.
+	 * @param f Callback invoked with an entry and a copy of the node it links to, for every name resolved.
+	 * Callback is invoked with no locks held.
+	 * @return Entry the path resolves to or an error.
+	 */
 	template<typename P, typename F>
 	Result<Entry>
 	walk(User user, INode::Id rootId, P const& path, F&& f) const {
-        auto maybeNode = nodeById(rootId);
-        if (!maybeNode) {   // Valid file id required to start the walk
-			return makeError(Solace::GenericError::BADF , "walk");
-        }
-
-        auto resultingEntry = Entry{kThisDir, rootId};
-		for (auto pathSegment : path) {
-			INode node = *maybeNode;
-			if (!node.userCan(user, Permissions::READ)) {
-				return makeError(Solace::GenericError::PERM, "walk");
-            }
-
-			auto maybeEntry = lookup(resultingEntry.nodeId, pathSegment);
-            if (!maybeEntry) {
-				return makeError(Solace::GenericError::NOENT, "walk");
-            }
+		auto const pinned = EpochReclaimer::pin();
 
-			resultingEntry = maybeEntry.move();
-            maybeNode = nodeById(resultingEntry.nodeId);
-            if (!maybeNode) {  // FIXME: It is fs consistency error if entry.index does not exist. Must be hadled here.
-				return makeError(Solace::GenericError::NXIO, "walk");
-            }
+		return resolve(user, rootId, path, std::forward<F>(f));
+	}
 
-			// Invoke the callback handler
-			f(resultingEntry, *maybeNode);
-        }
+	/**
+	 * Resolve a path starting from the given node.
+	 * If dentry cache is enabled, a previously resolved path is served from the cache.
+	 * @param user User performing the walk. User must have read permission for every directory on the path.
+	 * @param rootId Id of the node to start the walk from.
+	 * @param path Path to resolve.
+	 * @return Entry the path resolves to or an error.
+	 */
+	Result<Entry>
+	walk(User user, INode::Id rootId, Solace::Path const& path) const {
+		return walkCached(user, rootId, path);
+	}
 
-		return Result<Entry>{Solace::types::okTag, Solace::in_place, resultingEntry};
-    }
+	/**
+	 * Resolve a path string, such as "a/b/c", starting from the given node.
+	 * Path is tokenized in place, so no memory is allocated to resolve it unless it is added to the dentry cache.
+	 * @param user User performing the walk. User must have read permission for every directory on the path.
+	 * @param rootId Id of the node to start the walk from.
+	 * @param path Path to resolve. Segments are separated by '/'.
+	 * @return Entry the path resolves to or an error.
+	 */
+	Result<Entry>
+	walk(User user, INode::Id rootId, Solace::StringView path) const {
+		return walkCached(user, rootId, PathSegments{path});
+	}
 
-	auto walk(User user, INode::Id rootId, Solace::Path const& path) const {
-		return walk(user, rootId, path, [](Entry const&, INode const&){});
+	/**
+	 * Resolve a path literal that has been split at compile time.
+	 * @see StaticPath
+	 */
+	template<std::size_t N>
+	Result<Entry>
+	walk(User user, INode::Id rootId, StaticPath<N> const& path) const {
+		return walkCached(user, rootId, path);
 	}
 
 	auto walk(User user, Solace::Path const& path) const {
 		return walk(user, rootId(), path);
 	}
 
+	/**
+	 * Resolve a batch of paths starting from the given node.
+	 * Paths that share a prefix are resolved together: lookups and permission checks for the prefix are done once.
+	 * @param user User performing the walk. User must have read permission for every directory on the paths.
+	 * @param rootId Id of the node to start the walk from.
+	 * @param paths Range of paths to resolve. Each path is a range of path segments, such as Solace::Path or PathSegments.
+	 * @return Result of resolving each of the paths, in the same order as the paths given.
+	 */
+	template<typename Paths>
+	std::vector<Result<Entry>>
+	walkMany(User user, INode::Id rootId, Paths const& paths) const {
+		std::vector<Solace::StringView> segments;
+		std::vector<size_type> bounds{0};  // Path i consists of segments [bounds[i], bounds[i + 1])
+		for (auto const& path : paths) {
+			for (auto segment : path) {
+				segments.push_back(segment);
+			}
+			bounds.push_back(segments.size());
+		}
+
+		return walkMany(user, rootId, segments, bounds);
+	}
+
+	/**
+	 * Enable caching of resolved paths.
+	 * @param capacity Max number of cached paths.
+	 */
+	void enableDentryCache(DentryCache::size_type capacity);
+
+	/// Disable caching of resolved paths and drop the cache.
+	void disableDentryCache();
+
+	/// Get dentry cache statistics, if cache is enabled.
+	Solace::Optional<DentryCache::Stats> dentryCacheStats() const {
+		auto const pinned = EpochReclaimer::pin();
+		auto const* cache = _locks->dentryCache.load(std::memory_order_acquire);
+
+		return cache
+				? Solace::Optional<DentryCache::Stats>{cache->stats()}
+				: Solace::none;
+	}
+
 	/**
 	 * Create a node of the given type and link it to the specified root.
 	 * @param user Owner of the node to be created. Note this user must have write permission to the location.
@@ -303,24 +484,71 @@ public:
 	 * @param fid Id of the file to be opened.
 	 * @param op Opearions to be performed on the file.
 	 * @return Result - either an IO object or an error.
+	 * @note File uses metadata policy of the vfs that serves the node.
 	 */
 	Result<File>
 	open(User user, INode::Id fid, Permissions op);
 
+	/**
+	 * Open a file for IO operations with the given metadata policy.
+	 * @param user User principal requesting operation.
+	 * @param fid Id of the file to be opened.
+	 * @param op Opearions to be performed on the file.
+	 * @param policy Policy of updating node metadata by IO operations.
+	 * @return Result - either an IO object or an error.
+	 */
+	Result<File>
+	open(User user, INode::Id fid, Permissions op, MetadataPolicy policy);
+
 protected:
 
 	/**
      * @brief Find directory entry in the given inode.
      * @param dirNodeId Id of the Node to search link from.
      * @param name Name of the link to find.
+     * @param version Version of the namespace to find the entry in.
      * @return Either an entry record or none.
+	 * @note Lock-free: name of the entry remains valid while the caller is pinned.
      */
     Solace::Optional<Entry>
-	lookup(INode::Id dirNodeId, Solace::StringView name) const noexcept;
+	lookup(INode::Id dirNodeId, Solace::StringView name, Version version = DirectoryEntries::kLatest) const noexcept;
 
+	/// Find driver of a node. Caller must hold the registry lock.
 	Solace::Optional<Filesystem*>
 	findFsOf(INode const& vnode) const noexcept {
-		return findFs(vnode.fsTypeId);
+		return driverOf(vnode.fsTypeId);
+	}
+
+	/**
+	 * Copy a node that is live at the given version of the namespace. Lock-free.
+	 * @note Reading an earlier version follows retained states of the node, so the caller must be pinned.
+	 */
+	Solace::Optional<INode>
+	readNode(INode::Id id, Version version = DirectoryEntries::kLatest) const noexcept {
+		if (id.index >= _index->size()) {
+			return Solace::none;
+		}
+
+		auto const& entry = (*_index)[id.index];
+		auto published = entry.read();
+		if (published.since > version) {  // Node has been modified since: find the state it had at the version
+			auto const* record = entry.history.load(std::memory_order_acquire);
+			while (record && record->state.since > version) {
+				record = record->older.load(std::memory_order_acquire);
+			}
+
+			if (!record) {
+				return Solace::none;
+			}
+
+			published = record->state;
+		}
+
+		if (published.gen != id.gen || !published.isLive) {
+			return Solace::none;
+		}
+
+		return published.inode;
 	}
 
 	/// Create unlinked node
@@ -333,32 +561,674 @@ protected:
 	void
 	addNodeLink(INode::Id id) noexcept;
 
+	/// Unregister a file opened for a node, releasing the slot of the node if it has been unlinked.
+	void
+	closeFile(INode::Id id, VfsId fsTypeId) noexcept;
+
+	/// Access a node that is open, even if it has been unlinked.
+	template<typename F>
+	auto withOpenNode(INode::Id id, F&& f) const {
+		std::shared_lock<std::shared_mutex> node{nodeLock(id.index)};
+
+		return visitEntry(openEntryById(id), std::forward<F>(f));
+	}
+
+	/// Modify a node that is open, even if it has been unlinked.
+	template<typename F>
+	auto modifyOpenNode(INode::Id id, F&& f) {
+		auto modification = beginModification();
+		std::unique_lock<std::shared_mutex> node{nodeLock(id.index)};
+		assignVersion(modification);
+
+		return modifyEntry(openEntryById(id), id.index, modification, std::forward<F>(f));
+	}
+
+	/**
+	 * Publish the current size of data of nodes the driver changed on its own, see Filesystem::takeChangedNodes.
+	 * Must be called with no locks held.
+	 */
+	void
+	publishChangedNodes(Filesystem& fs);
+
+	/// Open a file for a node. Caller must hold the registry lock.
+	Result<File>
+	openNode(User user, INode::Id fid, Permissions op, MetadataPolicy policy);
+
+	/// Validate a cached path resolution and check permissions along its chain
+	Solace::Optional<Result<Entry>>
+	resolveCached(User user, DentryCache::Record const& record) const;
+
+	/// Test if a walk failed because the directory it stopped at has no entry with the given name
+	bool
+	isMissingName(User user, INode::Id dirId, Solace::StringView name) const;
+
+	/// Resolve a batch of paths given as spans of path segments
+	std::vector<Result<Entry>>
+	walkMany(User user, INode::Id rootId,
+			 std::vector<Solace::StringView> const& segments,
+			 std::vector<size_type> const& bounds) const;
+
+	/// Resolve a path, invoking a callback for every node resolved on the way. Caller must be pinned.
+	template<typename P, typename F>
+	Result<Entry>
+	resolve(User user, INode::Id rootId, P const& path, F&& f, Version version = DirectoryEntries::kLatest) const {
+		auto currentNode = readNode(rootId, version);
+		if (!currentNode) {   // Valid file id required to start the walk
+			return makeError(Solace::GenericError::BADF , "walk");
+		}
+
+		WalkTrail trail;
+		auto resultingEntry = Entry{kThisDir, rootId};
+		size_type nWalked = 0;  // Number of segments of the path walked so far
+		for (auto pathSegment : path) {
+			auto const position = nWalked++;
+			bool const isDotSegment = pathSegment.equals(kThisDir) || pathSegment.equals(kParentDir);
+			if (isDotSegment && !isDirectory(*currentNode)) {
+				return makeError(Solace::GenericError::NOTDIR, "walk");
+			}
+
+			if (pathSegment.equals(kThisDir)) {
+				continue;
+			}
+
+			if (pathSegment.equals(kParentDir)) {
+				if (trail.depth == 0) {
+					resultingEntry = Entry{kThisDir, rootId};
+				} else if (!trail.pop(resultingEntry)) {  // Parent has dropped out of the trail: walk to it again
+					auto maybeParent = rewalk(rootId, path, position, trail.depth - 1, trail, version);
+					if (!maybeParent) {
+						return makeError(Solace::GenericError::NXIO, "walk");
+					}
+
+					resultingEntry = maybeParent.move();
+				}
+
+				currentNode = readNode(resultingEntry.nodeId, version);
+				if (!currentNode) {
+					return makeError(Solace::GenericError::NXIO, "walk");
+				}
+
+				continue;
+			}
+
+			if (!(*currentNode).userCan(user, Permissions::READ)) {
+				return makeError(Solace::GenericError::PERM, "walk");
+			}
+
+			auto maybeEntry = lookup(resultingEntry.nodeId, pathSegment, version);
+			if (!maybeEntry) {
+				return makeError(Solace::GenericError::NOENT, "walk");
+			}
+
+			trail.push(resultingEntry);
+			resultingEntry = maybeEntry.move();
+			currentNode = readNode(resultingEntry.nodeId, version);
+			if (!currentNode) {  // FIXME: It is fs consistency error if entry.index does not exist. Must be hadled here.
+				return makeError(Solace::GenericError::NXIO, "walk");
+			}
+
+			// Invoke the callback handler
+			f(resultingEntry, *currentNode);
+		}
+
+		return Result<Entry>{Solace::types::okTag, Solace::in_place, resultingEntry};
+	}
+
+	/// Resolve a path, using dentry cache if it is enabled
+	template<typename P>
+	Result<Entry>
+	walkCached(User user, INode::Id rootId, P const& path) const {
+		auto const pinned = EpochReclaimer::pin();  // Cache remains valid while pinned, even if it is disabled
+		auto* const maybeCache = _locks->dentryCache.load(std::memory_order_acquire);
+		if (!maybeCache || path.empty() || isRelative(path)) {
+			return resolve(user, rootId, path, [](Entry const&, INode const&) {});
+		}
+
+		auto& cache = *maybeCache;
+		auto const pathHash = DentryCache::hashOf(rootId, path);
+		{  // Record is only valid while its stripe is locked
+			auto const dentries = cache.lock(pathHash);
+			auto const* record = cache.find(rootId, pathHash, path);
+			if (record) {
+				auto maybeResolved = resolveCached(user, *record);
+				if (maybeResolved) {
+					return maybeResolved.move();
+				}
+
+				cache.evict(*record);
+			}
+		}
+
+		auto const startNode = readNode(rootId);
+		if (!startNode) {
+			return makeError(Solace::GenericError::BADF, "walk");
+		}
+
+		std::vector<DentryCache::Step> chain;
+		chain.push_back({rootId, (*startNode).version});
+		auto result = resolve(user, rootId, path, [&chain](Entry const& entry, INode const& node) {
+			chain.push_back({entry.nodeId, node.version});
+		});
+
+		if (result) {  // Last node of the chain is the resolved node itself, not a directory traversed
+			chain.pop_back();
+
+			auto const dentries = cache.lock(pathHash);
+			cache.insert(rootId, pathHash, path, chain, *result);
+			return result;
+		}
+
+		// Path has no dot segments, so the walk stopped at the segment following the last node of the chain
+		auto segment = path.begin();
+		for (std::size_t i = 1; i < chain.size(); ++i) {
+			++segment;
+		}
+
+		if (segment != path.end() && isMissingName(user, chain.back().dirId, *segment)) {
+			// Linking into the directory where the name is missing invalidates the record
+			auto const dentries = cache.lock(pathHash);
+			cache.insertNegative(rootId, pathHash, path, chain);
+		}
+
+		return result;
+	}
+
+	/// Test if a path has "." or ".." segments
+	template<typename P>
+	static bool isRelative(P const& path) noexcept {
+		for (auto segment : path) {
+			if (segment.equals(kThisDir) || segment.equals(kParentDir))
+				return true;
+		}
+
+		return false;
+	}
+
 	friend struct EntriesEnumerator;
+	friend struct File;
 
 private:
 
+	static constexpr Solace::uint32 kNoSlot = static_cast<Solace::uint32>(-1);
+
+	/// Number of locks nodes are striped over
+	static constexpr Solace::uint32 kLockStripes = 64;
+
+	/**
+	 * Locks of the VFS. Locks are kept out of line so that VFS remains movable.
+	 * Order of locking: registry, versions, nodes in the order of stripes, slots.
+	 * Locks of the dentry cache are taken last: no other lock is taken while one is held.
+	 */
+	struct Locks {
+		std::shared_mutex								registry;	//!< The driver registry and the dentry cache
+		std::shared_mutex								versions;	//!< Snapshots: shared by writers, exclusive to take a snapshot
+		std::array<std::shared_mutex, kLockStripes>	nodes;		//!< Nodes and entries of directories, striped by node index
+		std::mutex										slots;		//!< Growth of the index, free list, reclaim queue and counters
+		std::atomic<DentryCache*>						dentryCache{nullptr};	//!< Cache used by walks, if enabled
+		std::atomic<Version>							version{0};	//!< Version of the last modification of the namespace
+	};
+
+	/**
+	 * Modification of the namespace in progress. Snapshots can not be taken while it is made.
+	 * Version is assigned once the nodes to modify are locked, so that versions of a node only ever grow.
+	 */
+	struct Modification {
+		std::shared_lock<std::shared_mutex>	lock;
+		Version								newestSnapshot;	//!< Version of the newest snapshot, 0 if there are none
+		Version								version{0};		//!< Version of the namespace made by the modification
+
+		bool hasSnapshots() const noexcept { return newestSnapshot != 0; }
+	};
+
+	/// Start a modification of the namespace. Must not be called while another modification is in progress.
+	Modification beginModification() const;
+
+	/// Assign a new version to a modification. Caller must hold locks of the nodes it modifies.
+	void assignVersion(Modification& modification) const noexcept {
+		modification.version = _locks->version.fetch_add(1, std::memory_order_acq_rel) + 1;
+	}
+
+	/// Exclusive locks of two nodes
+	struct NodesLock {
+		std::unique_lock<std::shared_mutex>	first;
+		std::unique_lock<std::shared_mutex>	second;
+	};
+
+	std::shared_mutex& nodeLock(Solace::uint32 index) const noexcept {
+		return _locks->nodes[index % kLockStripes];
+	}
+
+	static bool isSameLock(Solace::uint32 lhs, Solace::uint32 rhs) noexcept {
+		return (lhs % kLockStripes) == (rhs % kLockStripes);
+	}
+
+	/// Lock two nodes exclusively, in the order of their stripes so that writers never deadlock.
+	NodesLock lockNodes(Solace::uint32 lhs, Solace::uint32 rhs) const;
+
+	/// Find registered driver. Caller must hold the registry lock.
+	Solace::Optional<Filesystem*>
+	driverOf(VfsId id) const noexcept {
+		if (id >= _drivers.size() || !_drivers[id].fs) {
+			return Solace::none;
+		}
+
+		return _drivers[id].fs.get();
+	}
+
+	/**
+	 * Directories a walk descended through, so that ".." can be resolved without parent links.
+	 * Only the last kWalkTrailSize directories are kept to avoid memory allocation: older ones are resolved
+	 * again from the path if a walk climbs back up to them, see Vfs::rewalk.
+	 */
+	struct WalkTrail {
+		static constexpr Solace::uint32 kWalkTrailSize = 32;
+
+		struct Position {
+			Solace::StringView	name;
+			INode::Id			nodeId{0, 0};
+		};
+
+		void push(Entry const& entry) noexcept {
+			auto& position = positions[depth % kWalkTrailSize];
+			position.name = entry.name;
+			position.nodeId = entry.nodeId;
+			depth += 1;
+			retained = std::min(retained + 1, kWalkTrailSize);
+		}
+
+		bool pop(Entry& entry) noexcept {
+			if (retained == 0)
+				return false;
+
+			depth -= 1;
+			retained -= 1;
+			auto const& position = positions[depth % kWalkTrailSize];
+			entry = Entry{position.name, position.nodeId};
+			return true;
+		}
+
+		std::array<Position, kWalkTrailSize>	positions;
+		Solace::uint32						depth{0};		//!< Number of directories walk descended through
+		Solace::uint32						retained{0};	//!< Number of directories retained in the trail
+	};
+
+	/**
+	 * Resolve a directory a walk has descended through again, once it has dropped out of the trail of the walk.
+	 * The trail is refilled with the directories on the way, so that the following ".." segments use it.
+	 * @param path Path being walked.
+	 * @param nSegments Number of segments of the path walked so far.
+	 * @param depth Depth of the directory to resolve.
+	 * @return Entry of the directory, or none if it can no longer be found.
+	 */
+	template<typename P>
+	Solace::Optional<Entry>
+	rewalk(INode::Id rootId, P const& path, size_type nSegments, Solace::uint32 depth, WalkTrail& trail,
+		   Version version) const {
+		// ".." refers to the directory the walk descended from, so directories walked are given by the path itself
+		std::vector<Solace::StringView> names;
+		size_type position = 0;
+		for (auto segment : path) {
+			if (position++ == nSegments)
+				break;
+
+			if (segment.equals(kThisDir))
+				continue;
+
+			if (segment.equals(kParentDir)) {
+				if (!names.empty()) {
+					names.pop_back();
+				}
+				continue;
+			}
+
+			names.push_back(segment);
+		}
+
+		if (depth > names.size()) {
+			return Solace::none;
+		}
+
+		// Note: Permissions of the directories have been checked as the walk descended through them
+		trail = WalkTrail{};
+		auto entry = Entry{kThisDir, rootId};
+		for (Solace::uint32 i = 0; i < depth; ++i) {
+			auto maybeEntry = lookup(entry.nodeId, names[i], version);
+			if (!maybeEntry) {
+				return Solace::none;
+			}
+
+			trail.push(entry);
+			entry = maybeEntry.move();
+		}
+
+		return entry;
+	}
+
+	/// State of a slot of the inode table that is visible to lock-free readers
+	struct PublishedNode {
+		Solace::uint32		gen;
+		Solace::uint32		isLive;
+		Version				since;		//!< Version of the namespace the state was published in
+		INode				inode;
+	};
+
+	static_assert(std::is_trivially_copyable<PublishedNode>::value, "Published node must be copyable as raw words");
+
+	/// Earlier state of a slot, retained for snapshots. States of a slot are chained from the newest to the oldest.
+	struct NodeVersion : public EpochReclaimer::Retirable {
+		NodeVersion(PublishedNode s, Version replacedIn, NodeVersion const* next) noexcept
+			: state{s}
+			, until{replacedIn}
+			, older{next}
+		{}
+
+		PublishedNode						state;
+		Version								until;		//!< Version the state was replaced in
+		/// Previous state, or null if it is not retained. The only field that changes once the state is retained.
+		mutable std::atomic<NodeVersion const*>	older;
+	};
+
+	/**
+	 * Slot of the inode table.
+	 * Released slots are chained into an intrusive free list and reused by new nodes.
+	 * Slot generation is bumped on release so that stale node Ids never match a reused slot.
+	 * A node that is unlinked while open is orphaned: it is not live, but its slot is not released until
+	 * all files opened for it are closed.
+	 * Slot is guarded by the lock of the node, see Vfs::nodeLock. Writers publish the slot once it is modified:
+	 * a copy of the slot is stored under a sequence counter, so that readers can copy it out without locking.
+	 * Published states replaced while there are snapshots are retained in the history of the slot.
+	 */
 	struct INodeEntry {
-		Solace::uint32		gen;				//!< VFS generation of node.
+		static constexpr std::size_t kPublishedWords = (sizeof(PublishedNode) + 7) / 8;
+
+		Solace::uint32		gen;				//!< Generation of the slot.
+		Solace::uint32		nextFree{kNoSlot};	//!< Next free slot index. Only meaningful for a released slot.
+		Solace::uint32		openCount{0};		//!< Number of files open for the node.
+		bool				isLive{true};		//!< True if the slot is occupied by a linked node.
+		bool				isVersioned{false};	//!< True if the slot is queued to trim. Guarded by the slots lock.
+		Version				createdAt;			//!< Version the node was created in
+		Version				unlinkedAt{0};		//!< Version the node was unlinked in
 		INode				inode;
 
-		constexpr INodeEntry(Solace::uint32 generation, INode node) noexcept
+		std::atomic<Solace::uint32>								seq{0};		//!< Odd while published copy is written
+		std::array<std::atomic<Solace::uint64>, kPublishedWords>	published;	//!< Copy of the slot for readers
+		std::atomic<NodeVersion const*>							history{nullptr};	//!< Retained earlier states
+
+		INodeEntry(Solace::uint32 generation, INode node, Version since) noexcept
 			: gen{generation}
+			, createdAt{since}
 			, inode{Solace::mv(node)}
-		{}
+		{
+			publish(since);
+		}
+
+		~INodeEntry() {
+			auto const* record = history.load(std::memory_order_relaxed);
+			while (record) {
+				auto const* older = record->older.load(std::memory_order_relaxed);
+				delete record;
+				record = older;
+			}
+		}
+
+		INodeEntry(INodeEntry const&) = delete;
+		INodeEntry& operator= (INodeEntry const&) = delete;
+
+		/// Publish the state of the slot to readers. Caller must hold the lock of the node.
+		void publish(Version since) noexcept {
+			PublishedNode const state{gen, isLive ? 1U : 0U, since, inode};
+			std::array<Solace::uint64, kPublishedWords> words{};
+			std::memcpy(words.data(), &state, sizeof(state));
+
+			auto const sequence = seq.load(std::memory_order_relaxed);
+			seq.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			for (std::size_t i = 0; i < kPublishedWords; ++i) {
+				published[i].store(words[i], std::memory_order_relaxed);
+			}
+			seq.store(sequence + 2, std::memory_order_release);
+		}
+
+		/// Read published state of the slot. Lock-free: retries if the slot is being published concurrently.
+		PublishedNode read() const noexcept {
+			std::array<Solace::uint64, kPublishedWords> words;
+			while (true) {
+				auto const sequence = seq.load(std::memory_order_acquire);
+				if (sequence & 1) {
+					continue;
+				}
+
+				for (std::size_t i = 0; i < kPublishedWords; ++i) {
+					words[i] = published[i].load(std::memory_order_relaxed);
+				}
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (seq.load(std::memory_order_relaxed) == sequence) {
+					break;
+				}
+			}
+
+			PublishedNode state{0, 0, 0, INode{0, User{0, 0}, FilePermissions{0}}};
+			std::memcpy(static_cast<void*>(&state), words.data(), sizeof(state));
+
+			return state;
+		}
 	};
 
-    /// Index nodes are vertices of a graph: e.g all addressable nodes
-	std::vector<INodeEntry>		_index;
-	DirFs						_directories;
+	INodeEntry* entryById(INode::Id id) noexcept {
+		if (id.index >= _index->size()) {
+			return nullptr;
+		}
+
+		auto& entry = (*_index)[id.index];
+		return (entry.gen == id.gen && entry.isLive)
+				? &entry
+				: nullptr;
+	}
+
+	INodeEntry const* entryById(INode::Id id) const noexcept {
+		if (id.index >= _index->size()) {
+			return nullptr;
+		}
+
+		auto& entry = (*_index)[id.index];
+		return (entry.gen == id.gen && entry.isLive)
+				? &entry
+				: nullptr;
+	}
+
+	INodeEntry* openEntryById(INode::Id id) noexcept {
+		if (id.index >= _index->size()) {
+			return nullptr;
+		}
+
+		auto& entry = (*_index)[id.index];
+		return (entry.gen == id.gen && (entry.isLive || entry.openCount > 0))
+				? &entry
+				: nullptr;
+	}
+
+	INodeEntry const* openEntryById(INode::Id id) const noexcept {
+		if (id.index >= _index->size()) {
+			return nullptr;
+		}
+
+		auto& entry = (*_index)[id.index];
+		return (entry.gen == id.gen && (entry.isLive || entry.openCount > 0))
+				? &entry
+				: nullptr;
+	}
+
+	template<typename F>
+	static auto visitEntry(INodeEntry const* entry, F&& f) -> Solace::Optional<decltype(f(entry->inode))> {
+		using ResultType = decltype(f(entry->inode));
+		if (!entry) {
+			return Solace::none;
+		}
+
+		return Solace::Optional<ResultType>{Solace::in_place, f(entry->inode)};
+	}
+
+	template<typename F>
+	auto modifyEntry(INodeEntry* entry, Solace::uint32 index, Modification const& modification, F&& f)
+	-> Solace::Optional<decltype(f(entry->inode))> {
+		using ResultType = decltype(f(entry->inode));
+		if (!entry) {
+			return Solace::none;
+		}
+
+		auto result = Solace::Optional<ResultType>{Solace::in_place, f(entry->inode)};
+		entry->inode.version += 1;
+		commit(*entry, index, modification);
+
+		return result;
+	}
+
+	/**
+	 * Publish a modified slot, retaining the state it replaces if there are snapshots.
+	 * Caller must hold the lock of the node.
+	 */
+	void commit(INodeEntry& entry, Solace::uint32 index, Modification const& modification) noexcept;
+
+	/// Drop a link to a node. Caller must hold the lock of the node.
+	void dropLink(INodeEntry& entry, Solace::uint32 index, Modification const& modification) noexcept;
+
+	/**
+	 * Destroy retained states of nodes and removed directory entries that no snapshot can read.
+	 * @param oldestVersion Version of the oldest snapshot, or kLatest if there are none.
+	 */
+	void trimHistory(Version oldestVersion);
+
+	/// Forget a snapshot, so that states only it could read can be trimmed
+	void releaseSnapshot(Version version) noexcept;
+
+	/**
+	 * Return slot of a node to the free list. Bumped generation invalidates all outstanding Ids
+	 * Caller must hold the lock of the node and the slots lock.
+	 */
+	void releaseSlot(Solace::uint32 index) noexcept;
+
+	/// Retire a chain of retained states of a slot
+	void retireHistory(NodeVersion const* record) noexcept;
+
+	/// Queue a node that is no longer linked nor open to be destroyed by Vfs::reclaim
+	void scheduleReclaim(Solace::uint32 index) noexcept;
+
+	std::unique_ptr<Locks>		_locks;
+
+    /// Index nodes are vertices of a graph: e.g all addressable nodes. Kept out of line so that VFS remains movable.
+	std::unique_ptr<ChunkedArray<INodeEntry>>	_index;
+	std::unique_ptr<DirFs>						_directories;
+
+	// Note: Free list, reclaim queue and counters are guarded by the slots lock
+	Solace::uint32				_freeListHead{kNoSlot};	//!< Index of the first released slot available for reuse.
+	size_type					_nodeCount{0};			//!< Number of live nodes in the index.
 
-	Solace::uint32				_genCount{0};				//!< VFS generation of node.
+	std::vector<Solace::uint32>	_reclaimQueue;			//!< Slots of nodes waiting to be destroyed
+	ReclaimStats				_reclaimStats;
+	std::vector<Solace::uint32>	_versionedNodes;		//!< Slots with retained states, to be trimmed by Vfs::reclaim
+
+	/// Versions of live snapshots. Guarded by the versions lock.
+	std::multiset<Version>		_snapshots;
+
+	/// Reclaimer of trimmed states of nodes, that lock-free readers may still be reading
+	std::unique_ptr<EpochReclaimer>	_retired;
+
+	/// Optional cache of resolved paths. Guarded by the registry lock, published to walks with Locks::dentryCache.
+	std::unique_ptr<DentryCache>	_dentryCache;
 
     /// Mounted filesystems
 //    std::vector<Mount> mounts;
 
-    /// Registered virtual filesystems
-	VfsId _nextId{0};
-	std::unordered_map<VfsId, std::unique_ptr<Filesystem>> _vfs;
+	/// Registered filesystem driver
+	struct DriverSlot {
+		explicit DriverSlot(std::unique_ptr<Filesystem> driver) noexcept
+			: fs{std::move(driver)}
+		{}
+
+		std::unique_ptr<Filesystem>	fs;				//!< Driver or null if it has been unregistered
+		Solace::uint32				openCount{0};	//!< Number of files open through the driver
+		MetadataPolicy				policy;			//!< Default metadata policy of files open through the driver
+	};
+
+	/// Registered virtual filesystems, indexed by VfsId. Ids of unregistered filesystems are not reused.
+	std::vector<DriverSlot>		_drivers;
+};
+
+
+/**
+ * Immutable view of the namespace of a Vfs at a point in time.
+ * Nodes and directories are seen as they were when the snapshot was taken, no matter how they have been
+ * modified since. Reads are lock-free, like reads of the live namespace.
+ */
+struct Vfs::Snapshot {
+
+	~Snapshot();
+
+	Snapshot(Snapshot const&) = delete;
+	Snapshot& operator= (Snapshot const&) = delete;
+
+	Snapshot(Snapshot&& rhs) noexcept;
+	Snapshot& operator= (Snapshot&& rhs) noexcept;
+
+	/// Version of the namespace the snapshot sees
+	Version version() const noexcept { return _version; }
+
+	/**
+	 * Find an inode as it was at the time of the snapshot.
+	 * @param id inode number.
+	 * @return Optional INode if the node existed when the snapshot was taken, none otherwise.
+	 */
+	Solace::Optional<INode> nodeById(INode::Id id) const noexcept;
+
+	/**
+	 * Resolve a path in the namespace as it was at the time of the snapshot.
+	 * @see Vfs::walk
+	 */
+	template<typename P, typename F>
+	Result<Entry>
+	walk(User user, INode::Id rootId, P const& path, F&& f) const {
+		auto const pinned = EpochReclaimer::pin();
+
+		return _vfs->resolve(user, rootId, path, std::forward<F>(f), _version);
+	}
+
+	Result<Entry>
+	walk(User user, INode::Id rootId, Solace::Path const& path) const {
+		return walk(user, rootId, path, [](Entry const&, INode const&) {});
+	}
+
+	Result<Entry>
+	walk(User user, INode::Id rootId, Solace::StringView path) const {
+		return walk(user, rootId, PathSegments{path}, [](Entry const&, INode const&) {});
+	}
+
+	auto walk(User user, Solace::Path const& path) const {
+		return walk(user, _vfs->rootId(), path);
+	}
+
+	/**
+	 * Enumerate entries of a directory as it was at the time of the snapshot.
+	 * @param user User performing the enumeration. User must have read permission for the directory.
+	 * @param dirId Id of the directory to enumerate.
+	 * @return Enumerator of the entries or an error.
+	 */
+	Result<EntriesEnumerator>
+	enumerateDirectory(User user, INode::Id dirId) const;
+
+private:
+	friend struct Vfs;
+
+	Snapshot(Vfs* vfs, Version version) noexcept
+		: _vfs{vfs}
+		, _version{version}
+	{}
+
+	/// Let the Vfs trim states that only this snapshot could read
+	void release() noexcept;
+
+	Vfs*		_vfs;
+	Version		_version;
 };
 
 
@@ -0,0 +1,57 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+#include "kasofs/dentryCache.hpp"
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+DentryCache::DentryCache(size_type capacity)
+	: _mask{0}
+{
+	std::size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+
+	_records.resize(size);
+	_mask = size - 1;
+}
+
+
+DentryCache::Stats
+DentryCache::stats() const {
+	Stats total;
+	for (auto& stripe : _stripes) {
+		std::lock_guard<std::mutex> lock{stripe.lock};
+		total.hits += stripe.stats.hits;
+		total.misses += stripe.stats.misses;
+		total.stale += stripe.stats.stale;
+		total.negativeHits += stripe.stats.negativeHits;
+	}
+
+	return total;
+}
+
+
+void
+DentryCache::evict(Record const& record) noexcept {
+	_records[record.pathHash & _mask].isValid = false;
+	stripeOf(record.pathHash).stats.stale += 1;
+}
+
+
+void
+DentryCache::clear() noexcept {
+	for (std::size_t i = 0; i < _records.size(); ++i) {
+		std::lock_guard<std::mutex> lock{_stripes[i % kLockStripes].lock};
+		_records[i].isValid = false;
+	}
+}
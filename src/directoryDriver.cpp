@@ -10,7 +10,8 @@
 
 #include <solace/posixErrorDomain.hpp>
 
-#include <functional>  // find_if
+#include <limits>
+
 
 
 using namespace kasofs;
@@ -20,21 +21,6 @@ VfsId const DirFs::kTypeId{0};
 VfsNodeType const DirFs::kNodeType{0};
 
 
-namespace kasofs {  // to make sure ADL works
-
-inline
-bool operator== (std::string const& s, StringView const& sview) noexcept {
-	return sview.equals(StringView(s.data(), s.size()));
-}
-
-inline
-StringView as_string_view(std::string const& str) noexcept {
-	return StringView(str.data(), str.size());
-}
-
-}  // namespace kasofs
-
-
 kasofs::Result<INode>
 DirFs::createNode(NodeType type, User owner, FilePermissions perms) {
 	if (kNodeType != type) {
@@ -43,10 +29,18 @@ DirFs::createNode(NodeType type, User owner, FilePermissions perms) {
 
 	INode node{type, owner, perms};
 	node.dataSize = 4096;
-	node.vfsData = nextId();
-	auto emplacement = _adjacencyList.try_emplace(node.vfsData, Entries{});
-	if (!emplacement.second) {
-		return makeError(GenericError::NFILE, "DirFs::createNode");
+
+	std::lock_guard<std::mutex> lock{_lock};
+	if (_freeIds.empty()) {
+		if (_directories.size() == std::numeric_limits<uint32>::max()) {
+			return makeError(GenericError::NFILE, "DirFs::createNode");
+		}
+
+		node.vfsData = _directories.size();
+		_directories.emplace_back();
+	} else {
+		node.vfsData = _freeIds.back();
+		_freeIds.pop_back();
 	}
 
 	return kasofs::Result<INode>{types::okTag, in_place, mv(node)};
@@ -58,7 +52,27 @@ DirFs::destroyNode(INode& node) {
 		return makeError(GenericError::NOTDIR, "DirFs::destroyNode");
 	}
 
-	_adjacencyList.erase(node.vfsData);
+	auto* entries = entriesOf(node);
+	if (!entries)
+		return Ok();
+
+	std::vector<NameHandle> names;
+	names.reserve(entries->size() + entries->retained());
+	entries->forEachAt(Entries::kLatest, [&names](Entries::Slot const& slot) { names.push_back(slot.handle); });
+	auto retainedNames = entries->purge(Entries::kLatest, _reclaimer);
+	names.insert(names.end(), retainedNames.begin(), retainedNames.end());
+	entries->clear(_reclaimer);
+
+	// Id of the directory is reused only once readers that may still look into it have unpinned
+	_reclaimer.retire([this, dataId = node.vfsData, names = mv(names)]() {
+		std::lock_guard<std::mutex> lock{_lock};
+		for (auto handle : names) {
+			_names.release(handle);
+		}
+
+		_freeIds.push_back(dataId);
+	});
+
 	return Ok();
 }
 
@@ -117,64 +131,69 @@ DirFs::close(OpenFID, INode& dirNode) {
 
 
 kasofs::Result<void>
-DirFs::addEntry(INode& dirNode, Entry entry) {
+DirFs::addEntry(INode& dirNode, Entry entry, Version version) {
 	if (!isDirectoryNode(dirNode)) {
 		return makeError(GenericError::NOTDIR , "DirFs::addEntry");
 	}
 
-	auto it = _adjacencyList.find(dirNode.vfsData);
-	if (it == _adjacencyList.end())
+	auto* entries = entriesOf(dirNode);
+	if (!entries)
 		return makeError(GenericError::NOENT, "DirFs::addEntry");
 
-	auto maybeEmplaced = it->second.try_emplace(std::string{entry.name.data(), entry.name.size()}, entry.nodeId);
-	if (maybeEmplaced.second == false) {
+	auto key = EntryName{entry.name};
+	if (entries->find(key))
 		return makeError(GenericError::EXIST, "DirFS::addEntry");
+
+	NameHandle handle;
+	{
+		std::lock_guard<std::mutex> lock{_lock};
+		handle = _names.intern(entry.name);
+		key.name = _names.name(handle);  // Entry views the interned copy of the name
 	}
 
+	entries->insert(key, handle, entry.nodeId, version, _reclaimer);
+
 	return Ok();
 }
 
 
 kasofs::Result<Optional<INode::Id>>
-DirFs::removeEntry(INode& dirNode, StringView name) {
+DirFs::removeEntry(INode& dirNode, StringView name, Version version, bool isRetained) {
 	if (!isDirectoryNode(dirNode)) {
 		return makeError(GenericError::NOTDIR, "DirFs::removeEntry");
 	}
 
-	auto it = _adjacencyList.find(dirNode.vfsData);
-	if (it == _adjacencyList.end())
+	auto* entries = entriesOf(dirNode);
+	if (!entries)
 		return makeError(GenericError::NOENT, "DirFs::removeEntry");
 
-	Optional<INode::Id> removedId;
-	auto& entries = it->second;
-	auto tmp = std::string{name.data(), name.size()};
-	auto entry = entries.find(tmp);
-	if (entry != entries.end()) {
-		removedId = entry->second;
-		entries.erase(entry);
+	auto maybeRemoved = entries->erase(EntryName{name}, version, isRetained, _reclaimer);
+	if (!maybeRemoved)
+		return Optional<INode::Id>{};
+
+	if (!isRetained) {  // Name may still be viewed by readers that found the entry before it was removed
+		releaseNames({(*maybeRemoved).handle});
 	}
 
-	return removedId;
+	return Optional<INode::Id>{(*maybeRemoved).nodeId};
 }
 
 
 Optional<Entry>
-DirFs::lookup(INode const& dirNode, StringView name) const noexcept {
+DirFs::lookup(INode const& dirNode, StringView name, Version version) const noexcept {
 	if (!isDirectoryNode(dirNode)) {
 		return none;
 	}
 
-	auto it = _adjacencyList.find(dirNode.vfsData);
-	if (it == _adjacencyList.end())
+	auto const* entries = entriesOf(dirNode);
+	if (!entries)
 		return none;
 
-	auto const& entries = it->second;
-	auto entryIt = std::find_if(entries.begin(), entries.end(),
-								[name](Entries::value_type const& e) { return e.first == name; });
+	auto const* slot = entries->find(EntryName{name}, version);
 
-	return (entryIt == entries.end())
-			? none
-			: Optional<Entry>{in_place, as_string_view(entryIt->first), entryIt->second};
+	return slot
+			? Optional<Entry>{in_place, slot->name.name, slot->nodeId}
+			: none;
 }
 
 
@@ -184,9 +203,9 @@ DirFs::countEntries(INode const& dirNode) const noexcept {
 		return 0;
 	}
 
-	auto it = _adjacencyList.find(dirNode.vfsData);
-	return (it != _adjacencyList.end())
-			? it->second.size()
+	auto const* entries = entriesOf(dirNode);
+	return entries
+			? entries->size()
 			: 0;
 }
 
@@ -197,10 +216,54 @@ DirFs::enumerateEntries(Vfs& vfs, INode::Id dirNodeId, INode const& dirNode) con
 		return makeError(GenericError::NOTDIR, "DirFs::enumerateEntries");
 	}
 
-	auto it = _adjacencyList.find(dirNode.vfsData);
-	if (it == _adjacencyList.end())
+	auto const* entries = entriesOf(dirNode);
+	if (!entries)
+		return makeError(GenericError::NOENT, "DirFs::enumerateEntries");
+
+	return kasofs::Result<EntriesEnumerator>{types::okTag, in_place, vfs, dirNodeId, *entries};
+}
+
+
+kasofs::Result<EntriesEnumerator>
+DirFs::enumerateEntries(INode const& dirNode, Version version) const noexcept {
+	if (!isDirectoryNode(dirNode)) {
+		return makeError(GenericError::NOTDIR, "DirFs::enumerateEntries");
+	}
+
+	auto const* entries = entriesOf(dirNode);
+	if (!entries)
 		return makeError(GenericError::NOENT, "DirFs::enumerateEntries");
 
-	auto& entries = it->second;
-	return kasofs::Result<EntriesEnumerator>{types::okTag, in_place, vfs, dirNodeId, entries};
+	return kasofs::Result<EntriesEnumerator>{types::okTag, in_place, *entries, version};
+}
+
+
+bool
+DirFs::purge(INode const& dirNode, Version oldestVersion) {
+	if (!isDirectoryNode(dirNode)) {
+		return false;
+	}
+
+	auto* entries = entriesOf(dirNode);
+	if (!entries)
+		return false;
+
+	auto purged = entries->purge(oldestVersion, _reclaimer);
+	if (!purged.empty()) {
+		releaseNames(mv(purged));
+	}
+
+	return entries->retained() > 0;
+}
+
+
+void
+DirFs::releaseNames(std::vector<NameHandle> names) {
+	// Names may still be viewed by readers that found the entries before they were removed
+	_reclaimer.retire([this, names = mv(names)]() {
+		std::lock_guard<std::mutex> lock{_lock};
+		for (auto handle : names) {
+			_names.release(handle);
+		}
+	});
 }
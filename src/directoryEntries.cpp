@@ -0,0 +1,228 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+#include "kasofs/directoryEntries.hpp"
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+DirectoryEntries::Slot const DirectoryEntries::kTombstone{EntryName{StringView{}}, 0, INode::Id{0, 0}, kNever};
+
+
+namespace /* anonymous */ {
+
+/// Number of buckets to hold the given number of entries with load factor of at most 1/2
+DirectoryEntries::size_type
+capacityFor(DirectoryEntries::size_type nEntries) noexcept {
+	if (nEntries == 0)
+		return 0;
+
+	auto capacity = DirectoryEntries::kMinCapacity;
+	while (capacity < 2 * nEntries) {
+		capacity *= 2;
+	}
+
+	return capacity;
+}
+
+}  // anonymous namespace
+
+
+DirectoryEntries::Table::Table(size_type capacity)
+	: mask{capacity - 1}
+	, buckets{std::make_unique<std::atomic<Slot const*>[]>(capacity)}
+{
+	for (size_type i = 0; i < capacity; ++i) {
+		buckets[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+
+DirectoryEntries::~DirectoryEntries() {
+	auto* table = _table.load(std::memory_order_relaxed);
+	if (!table)
+		return;
+
+	forEachSlot([](Slot const& slot) { delete &slot; });
+	delete table;
+}
+
+
+DirectoryEntries::Slot const*
+DirectoryEntries::find(EntryName const& name, Version version) const noexcept {
+	auto const* table = _table.load(std::memory_order_acquire);
+	if (!table)
+		return nullptr;
+
+	auto position = static_cast<size_type>(name.hash) & table->mask;
+	for (size_type i = 0; i <= table->mask; ++i) {
+		auto const* slot = table->buckets[position].load(std::memory_order_acquire);
+		if (!slot)
+			break;
+
+		if (slot != &kTombstone && slot->isVisibleAt(version) && EntryName::Equal{}(slot->name, name))
+			return slot;
+
+		position = (position + 1) & table->mask;
+	}
+
+	return nullptr;
+}
+
+
+bool
+DirectoryEntries::insert(EntryName name, NameHandle handle, INode::Id nodeId, Version version,
+						 EpochReclaimer& reclaimer) {
+	if (find(name))
+		return false;
+
+	auto const newSize = size() + 1;
+	auto* table = _table.load(std::memory_order_relaxed);
+	if (!table || 4 * (table->nUsed + 1) > 3 * (table->mask + 1)) {
+		rebuild(capacityFor(newSize + _nRetained), reclaimer);
+		table = _table.load(std::memory_order_relaxed);
+	}
+
+	auto slot = std::make_unique<Slot const>(name, handle, nodeId, version);
+
+	// Entry is known to be missing, so it goes to the first bucket that is not occupied by a slot
+	auto position = static_cast<size_type>(name.hash) & table->mask;
+	while (true) {
+		auto const* existing = table->buckets[position].load(std::memory_order_relaxed);
+		if (!existing || existing == &kTombstone) {
+			if (!existing) {
+				table->nUsed += 1;
+			}
+
+			table->buckets[position].store(slot.release(), std::memory_order_release);
+			break;
+		}
+
+		position = (position + 1) & table->mask;
+	}
+
+	_size.store(newSize, std::memory_order_release);
+	return true;
+}
+
+
+Optional<DirectoryEntries::Slot>
+DirectoryEntries::erase(EntryName const& name, Version version, bool isRetained, EpochReclaimer& reclaimer) {
+	auto* table = _table.load(std::memory_order_relaxed);
+	if (!table)
+		return none;
+
+	auto position = static_cast<size_type>(name.hash) & table->mask;
+	for (size_type i = 0; i <= table->mask; ++i) {
+		auto const* slot = table->buckets[position].load(std::memory_order_relaxed);
+		if (!slot)
+			break;
+
+		if (slot != &kTombstone && slot->isVisibleAt(kLatest) && EntryName::Equal{}(slot->name, name)) {
+			_size.store(size() - 1, std::memory_order_release);
+			if (isRetained) {  // Slot stays in the table, visible to versions before the removal
+				slot->removed.store(version, std::memory_order_release);
+				_nRetained += 1;
+
+				return Optional<Slot>{in_place, *slot};
+			}
+
+			table->buckets[position].store(&kTombstone, std::memory_order_release);
+			Optional<Slot> removed{in_place, *slot};
+			reclaimer.retire(slot);
+			shrink(reclaimer);
+
+			return removed;
+		}
+
+		position = (position + 1) & table->mask;
+	}
+
+	return none;
+}
+
+
+std::vector<DirectoryEntries::NameHandle>
+DirectoryEntries::purge(Version oldestVersion, EpochReclaimer& reclaimer) {
+	std::vector<NameHandle> purged;
+	auto* table = _table.load(std::memory_order_relaxed);
+	if (!table || _nRetained == 0)
+		return purged;
+
+	// A slot removed in version V is visible to versions before V only
+	for (size_type i = 0; i <= table->mask; ++i) {
+		auto const* slot = table->buckets[i].load(std::memory_order_relaxed);
+		if (slot && slot != &kTombstone && slot->removed.load(std::memory_order_relaxed) <= oldestVersion) {
+			table->buckets[i].store(&kTombstone, std::memory_order_release);
+			purged.push_back(slot->handle);
+			reclaimer.retire(slot);
+		}
+	}
+
+	_nRetained -= static_cast<size_type>(purged.size());
+	shrink(reclaimer);
+
+	return purged;
+}
+
+
+void
+DirectoryEntries::clear(EpochReclaimer& reclaimer) {
+	auto* table = _table.exchange(nullptr, std::memory_order_acq_rel);
+	_size.store(0, std::memory_order_release);
+	_nRetained = 0;
+	if (!table)
+		return;
+
+	for (size_type i = 0; i <= table->mask; ++i) {
+		auto const* slot = table->buckets[i].load(std::memory_order_relaxed);
+		if (slot && slot != &kTombstone) {
+			reclaimer.retire(slot);
+		}
+	}
+
+	reclaimer.retire(static_cast<Table const*>(table));
+}
+
+
+void
+DirectoryEntries::shrink(EpochReclaimer& reclaimer) {
+	auto const* table = _table.load(std::memory_order_relaxed);
+	auto const nSlots = size() + _nRetained;
+	if (table && 8 * nSlots < table->mask + 1 && table->mask + 1 > kMinCapacity) {
+		rebuild(capacityFor(nSlots), reclaimer);
+	}
+}
+
+
+void
+DirectoryEntries::rebuild(size_type capacity, EpochReclaimer& reclaimer) {
+	auto* oldTable = _table.load(std::memory_order_relaxed);
+
+	std::unique_ptr<Table> newTable;
+	if (capacity > 0) {
+		newTable = std::make_unique<Table>(capacity);
+		forEachSlot([&newTable](Slot const& slot) {
+			auto position = static_cast<size_type>(slot.name.hash) & newTable->mask;
+			while (newTable->buckets[position].load(std::memory_order_relaxed)) {
+				position = (position + 1) & newTable->mask;
+			}
+
+			newTable->buckets[position].store(&slot, std::memory_order_relaxed);
+			newTable->nUsed += 1;
+		});
+	}
+
+	// Slots are shared by both tables: only the old buckets are retired
+	_table.store(newTable.release(), std::memory_order_release);
+	if (oldTable) {
+		reclaimer.retire(static_cast<Table const*>(oldTable));
+	}
+}
@@ -0,0 +1,242 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+#include "kasofs/epochReclaimer.hpp"
+
+#include <array>
+#include <atomic>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+namespace /* anonymous */ {
+
+using Epoch = EpochReclaimer::Epoch;
+
+using Retirable = EpochReclaimer::Retirable;
+
+/// Epoch of a reader that is not pinned
+constexpr Epoch kIdle = 0;
+
+/// Slot of a reader. Slots are aligned to a cache line so that readers never share one.
+struct alignas(64) ReaderSlot {
+	std::atomic<Epoch>	epoch{kIdle};
+	std::atomic<bool>	isTaken{false};
+};
+
+std::atomic<Epoch>										gEpoch{1};
+std::array<ReaderSlot, EpochReclaimer::kMaxReaders>	gReaders;
+std::atomic<uint32>									gReadersWithoutSlot{0};	//!< Pinned readers that found no free slot
+
+
+/// Reader state of a thread. Slot is claimed on the first pin and released when the thread exits.
+struct ThreadReader {
+	~ThreadReader() {
+		if (slot) {
+			slot->isTaken.store(false, std::memory_order_release);
+		}
+	}
+
+	ReaderSlot* claimSlot() noexcept {
+		if (slot || hasNoSlot)
+			return slot;
+
+		for (auto& candidate : gReaders) {
+			bool expected = false;
+			if (!candidate.isTaken.load(std::memory_order_relaxed) &&
+				candidate.isTaken.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+				slot = &candidate;
+				return slot;
+			}
+		}
+
+		hasNoSlot = true;
+		return nullptr;
+	}
+
+	ReaderSlot*	slot{nullptr};
+	uint32		depth{0};
+	bool		hasNoSlot{false};	//!< All slots were taken when the thread tried to claim one
+};
+
+thread_local ThreadReader tReader;
+
+
+/// Retired function, for objects that have no hook of their own
+struct RetiredFunction : public Retirable {
+	explicit RetiredFunction(std::function<void()> f) noexcept
+		: destroy{mv(f)}
+	{}
+
+	std::function<void()>	destroy;
+};
+
+
+/// Advance global epoch if all pinned readers have observed the current one
+Epoch tryAdvance() noexcept {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	auto current = gEpoch.load(std::memory_order_acquire);
+	if (gReadersWithoutSlot.load(std::memory_order_acquire) > 0)
+		return current;
+
+	for (auto const& reader : gReaders) {
+		auto const epoch = reader.epoch.load(std::memory_order_acquire);
+		if (epoch != kIdle && epoch != current)
+			return current;
+	}
+
+	gEpoch.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel);
+	return gEpoch.load(std::memory_order_acquire);
+}
+
+}  // anonymous namespace
+
+
+EpochReclaimer::Guard
+EpochReclaimer::pin() noexcept {
+	auto& reader = tReader;
+	reader.depth += 1;
+	if (reader.depth > 1)
+		return Guard{};
+
+	auto* slot = reader.claimSlot();
+	if (slot) {
+		slot->epoch.store(gEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	} else {
+		gReadersWithoutSlot.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Announcement of the epoch must be visible before any shared object is read
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	return Guard{};
+}
+
+
+EpochReclaimer::Guard::Guard(Guard&& rhs) noexcept
+	: _isPinned{rhs._isPinned}
+{
+	rhs._isPinned = false;
+}
+
+
+EpochReclaimer::Guard::~Guard() {
+	if (!_isPinned)
+		return;
+
+	auto& reader = tReader;
+	reader.depth -= 1;
+	if (reader.depth > 0)
+		return;
+
+	if (reader.slot) {
+		reader.slot->epoch.store(kIdle, std::memory_order_release);
+	} else {
+		gReadersWithoutSlot.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+
+EpochReclaimer::~EpochReclaimer() {
+	auto const* retired = _retired.exchange(nullptr, std::memory_order_acquire);
+	while (retired) {
+		auto const* next = retired->_retiredNext;
+		retired->_destroy(retired);
+		retired = next;
+	}
+}
+
+
+void
+EpochReclaimer::retire(std::function<void()> destroy) {
+	retire(new RetiredFunction{mv(destroy)}, [](Retirable const* retired) noexcept {
+		auto const* function = static_cast<RetiredFunction const*>(retired);
+		function->destroy();
+		delete function;
+	});
+}
+
+
+void
+EpochReclaimer::retire(Retirable const* object, Retirable::Destroy destroy) {
+	// Object has been made unreachable before it is tagged with the epoch
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	object->_retiredEpoch = gEpoch.load(std::memory_order_acquire);
+	object->_destroy = destroy;
+	pushRetired(object, object);
+
+	auto const nPending = _nPending.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (nPending % kCollectThreshold == 0) {
+		collect();
+	}
+}
+
+
+void
+EpochReclaimer::pushRetired(Retirable const* first, Retirable const* last) noexcept {
+	auto const* head = _retired.load(std::memory_order_relaxed);
+	do {
+		last->_retiredNext = head;
+	} while (!_retired.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+EpochReclaimer::size_type
+EpochReclaimer::collect() {
+	// Objects are only ever taken from the list all at once, so a concurrent push never observes a reused head
+	auto const* retired = _retired.exchange(nullptr, std::memory_order_acquire);
+	if (!retired)
+		return 0;
+
+	// An object retired in epoch E may still be observed by readers pinned in E - 1 or E,
+	// so it is safe to destroy once the global epoch is at least E + 2.
+	tryAdvance();
+	auto const epoch = tryAdvance();
+
+	Retirable const* expired = nullptr;
+	Retirable const* keptFirst = nullptr;
+	Retirable const* keptLast = nullptr;
+	while (retired) {
+		auto const* next = retired->_retiredNext;
+		if (retired->_retiredEpoch + 2 <= epoch) {
+			retired->_retiredNext = expired;
+			expired = retired;
+		} else {
+			retired->_retiredNext = keptFirst;
+			keptFirst = retired;
+			keptLast = keptLast ? keptLast : retired;
+		}
+
+		retired = next;
+	}
+
+	if (keptFirst) {
+		pushRetired(keptFirst, keptLast);
+	}
+
+	// Objects are destroyed once they are out of the list, so that destruction may retire more objects
+	size_type nDestroyed = 0;
+	while (expired) {
+		auto const* next = expired->_retiredNext;
+		expired->_destroy(expired);
+		expired = next;
+		nDestroyed += 1;
+	}
+
+	_nPending.fetch_sub(nDestroyed, std::memory_order_relaxed);
+	return nDestroyed;
+}
+
+
+EpochReclaimer::size_type
+EpochReclaimer::pending() const {
+	return _nPending.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,213 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+#include "kasofs/extras/lzCodec.hpp"
+
+#include <solace/posixErrorDomain.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>  // memcpy
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+namespace /* anonymous */ {
+
+constexpr LzCodec::size_type kMinMatch = 4;
+constexpr LzCodec::size_type kMaxOffset = 0xFFFF;
+constexpr uint32 kHashBits = 12;
+constexpr byte kLengthMask = 0x0F;
+
+
+uint32 read32(byte const* p) noexcept {
+	uint32 value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+
+uint32 hashOf(uint32 sequence) noexcept {
+	return (sequence * 2654435761U) >> (32 - kHashBits);
+}
+
+
+/// Bounded writer of compressed data
+struct Output {
+	byte*				pos;
+	byte* const			end;
+
+	bool put(byte value) noexcept {
+		if (pos == end)
+			return false;
+
+		*pos++ = value;
+		return true;
+	}
+
+	bool put(byte const* src, LzCodec::size_type size) noexcept {
+		if (static_cast<LzCodec::size_type>(end - pos) < size)
+			return false;
+
+		if (size == 0)  // Source of empty data may be null
+			return true;
+
+		memcpy(pos, src, size);
+		pos += size;
+		return true;
+	}
+
+	/// Write the part of a length that does not fit into a token nibble
+	bool putLength(LzCodec::size_type length) noexcept {
+		for (; length >= 0xFF; length -= 0xFF) {
+			if (!put(0xFF))
+				return false;
+		}
+
+		return put(static_cast<byte>(length));
+	}
+
+	bool putSequence(byte const* literals, LzCodec::size_type literalsSize,
+					 LzCodec::size_type offset, LzCodec::size_type matchSize) noexcept {
+		auto const matchLength = (matchSize == 0) ? 0 : matchSize - kMinMatch;
+		auto const token = static_cast<byte>((std::min<LzCodec::size_type>(literalsSize, kLengthMask) << 4) |
+											 std::min<LzCodec::size_type>(matchLength, kLengthMask));
+		if (!put(token))
+			return false;
+
+		if (literalsSize >= kLengthMask && !putLength(literalsSize - kLengthMask))
+			return false;
+
+		if (!put(literals, literalsSize))
+			return false;
+
+		if (matchSize == 0)  // Last sequence has literals only
+			return true;
+
+		if (!put(static_cast<byte>(offset & 0xFF)) || !put(static_cast<byte>(offset >> 8)))
+			return false;
+
+		return (matchLength < kLengthMask) || putLength(matchLength - kLengthMask);
+	}
+};
+
+
+/// Read the part of a length that does not fit into a token nibble
+bool getLength(byte const*& pos, byte const* end, LzCodec::size_type& length) noexcept {
+	byte value;
+	do {
+		if (pos == end)
+			return false;
+
+		value = *pos++;
+		length += value;
+	} while (value == 0xFF);
+
+	return true;
+}
+
+}  // anonymous namespace
+
+
+LzCodec::size_type
+LzCodec::compress(MemoryView src, MutableMemoryView dest) noexcept {
+	std::array<size_type, 1 << kHashBits> table{};  // Position of a sequence + 1, 0 for none
+	auto const* in = src.dataAddress();
+	auto const srcSize = src.size();
+
+	Output out{dest.dataAddress(), dest.dataAddress() + dest.size()};
+	size_type pos = 0;
+	size_type anchor = 0;
+	while (pos + kMinMatch <= srcSize) {
+		auto const sequence = read32(in + pos);
+		auto& slot = table[hashOf(sequence)];
+		auto const candidate = slot;
+		slot = pos + 1;
+
+		if (candidate == 0 || pos - (candidate - 1) > kMaxOffset || read32(in + candidate - 1) != sequence) {
+			pos += 1;
+			continue;
+		}
+
+		auto const ref = candidate - 1;
+		auto matchSize = kMinMatch;
+		while (pos + matchSize < srcSize && in[ref + matchSize] == in[pos + matchSize]) {
+			matchSize += 1;
+		}
+
+		if (!out.putSequence(in + anchor, pos - anchor, pos - ref, matchSize))
+			return 0;
+
+		pos += matchSize;
+		anchor = pos;
+	}
+
+	if (!out.putSequence(in + anchor, srcSize - anchor, 0, 0))
+		return 0;
+
+	return static_cast<size_type>(out.pos - dest.dataAddress());
+}
+
+
+kasofs::Result<LzCodec::size_type>
+LzCodec::decompress(MemoryView src, MutableMemoryView dest) {
+	auto const* pos = src.dataAddress();
+	auto const* const end = pos + src.size();
+	auto* out = dest.dataAddress();
+	auto const destSize = dest.size();
+
+	size_type outSize = 0;
+	while (pos != end) {
+		auto const token = *pos++;
+
+		size_type literalsSize = token >> 4;
+		if (literalsSize == kLengthMask && !getLength(pos, end, literalsSize))
+			return makeError(GenericError::INVAL, "LzCodec::decompress");
+
+		if (static_cast<size_type>(end - pos) < literalsSize)
+			return makeError(GenericError::INVAL, "LzCodec::decompress");
+		if (destSize - outSize < literalsSize)
+			return makeError(GenericError::FBIG, "LzCodec::decompress");
+
+		if (literalsSize != 0) {  // Destination of empty data may be null
+			memcpy(out + outSize, pos, literalsSize);
+			pos += literalsSize;
+			outSize += literalsSize;
+		}
+
+		if (pos == end)  // Last sequence has literals only
+			break;
+
+		if (end - pos < 2)
+			return makeError(GenericError::INVAL, "LzCodec::decompress");
+
+		size_type const offset = pos[0] | (pos[1] << 8);
+		pos += 2;
+		if (offset == 0 || offset > outSize)
+			return makeError(GenericError::INVAL, "LzCodec::decompress");
+
+		size_type matchSize = token & kLengthMask;
+		if (matchSize == kLengthMask && !getLength(pos, end, matchSize))
+			return makeError(GenericError::INVAL, "LzCodec::decompress");
+
+		matchSize += kMinMatch;
+		if (destSize - outSize < matchSize)
+			return makeError(GenericError::FBIG, "LzCodec::decompress");
+
+		// Match may overlap the output being written, so it is copied byte by byte
+		auto const* ref = out + outSize - offset;
+		for (size_type i = 0; i < matchSize; ++i) {
+			out[outSize + i] = ref[i];
+		}
+		outSize += matchSize;
+	}
+
+	return Ok(outSize);
+}
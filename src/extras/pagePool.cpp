@@ -0,0 +1,200 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+#include "kasofs/extras/pagePool.hpp"
+
+#include <solace/posixErrorDomain.hpp>
+
+#include <algorithm>
+#include <utility>  // std::exchange
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+namespace /* anonymous */ {
+
+constexpr std::size_t kHugePageSize = 2 * 1024 * 1024;
+
+
+int createSharedMemory(PagePool::Backing backing) noexcept {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+	switch (backing) {
+	case PagePool::Backing::Heap:
+		return -1;
+	case PagePool::Backing::SharedMemory:
+		return memfd_create("kasofs-pages", MFD_CLOEXEC);
+	case PagePool::Backing::HugePages:
+#ifdef MFD_HUGETLB
+		return memfd_create("kasofs-pages", MFD_CLOEXEC | MFD_HUGETLB);
+#else
+		return -1;
+#endif
+	}
+#endif
+
+	return -1;
+}
+
+
+void closeSharedMemory(int fd) noexcept {
+#ifdef __linux__
+	if (fd >= 0) {
+		::close(fd);
+	}
+#endif
+}
+
+}  // anonymous namespace
+
+
+void
+PagePool::ChunkDeleter::operator() (byte* chunk) const noexcept {
+	if (mappedSize == 0) {
+		delete[] chunk;
+		return;
+	}
+
+#ifdef __linux__
+	munmap(chunk, mappedSize);
+#endif
+}
+
+
+PagePool::PagePool(uint64 capacity, Backing backing)
+	: _backing{backing}
+	, _fd{createSharedMemory(backing)}
+	, _maxPages{static_cast<size_type>(std::min<uint64>(capacity / kPageSize, static_cast<size_type>(-1)))}
+{
+	if (_backing == Backing::HugePages && _fd >= 0 && _maxPages > 0 && !grow()) {
+		// Huge pages may be supported but not reserved by the system. Probe it by mapping the first chunk.
+		closeSharedMemory(_fd);
+		_backing = Backing::SharedMemory;
+		_fd = createSharedMemory(_backing);
+	}
+
+	if (_fd < 0) {
+		_backing = Backing::Heap;
+	}
+}
+
+
+PagePool::~PagePool() {
+	_chunks.clear();
+	closeSharedMemory(_fd);
+}
+
+
+PagePool::PagePool(PagePool&& rhs) noexcept
+	: _backing{rhs._backing}
+	, _fd{std::exchange(rhs._fd, -1)}
+	, _maxPages{rhs._maxPages}
+	, _nextPage{rhs._nextPage}
+	, _freePages{std::move(rhs._freePages)}
+	, _refCounts{std::move(rhs._refCounts)}
+	, _chunks{std::move(rhs._chunks)}
+{
+}
+
+
+PagePool&
+PagePool::operator= (PagePool&& rhs) noexcept {
+	if (this != &rhs) {
+		_chunks.clear();
+		closeSharedMemory(_fd);
+
+		_backing = rhs._backing;
+		_fd = std::exchange(rhs._fd, -1);
+		_maxPages = rhs._maxPages;
+		_nextPage = rhs._nextPage;
+		_freePages = std::move(rhs._freePages);
+		_refCounts = std::move(rhs._refCounts);
+		_chunks = std::move(rhs._chunks);
+	}
+
+	return *this;
+}
+
+
+kasofs::Result<void>
+PagePool::grow() {
+	// Grow the pool by a chunk, but no further than the capacity
+	auto const firstPage = static_cast<uint64>(_chunks.size()) * kPagesPerChunk;
+	auto const nPages = std::min<uint64>(kPagesPerChunk, _maxPages - firstPage);
+	auto const chunkSize = static_cast<std::size_t>(nPages) * kPageSize;
+
+	if (_fd < 0) {
+		_chunks.emplace_back(new byte[chunkSize](), ChunkDeleter{});
+		return Ok();
+	}
+
+#ifdef __linux__
+	// Mappings of huge pages must be a whole number of huge pages
+	auto const mappedSize = (_backing == Backing::HugePages)
+			? (chunkSize + kHugePageSize - 1) / kHugePageSize * kHugePageSize
+			: chunkSize;
+
+	auto const fileOffset = static_cast<off_t>(firstPage * kPageSize);
+	if (0 != ftruncate(_fd, fileOffset + static_cast<off_t>(mappedSize)))
+		return makeError(GenericError::NOMEM, "PagePool::grow");
+
+	auto* chunk = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, fileOffset);
+	if (chunk == MAP_FAILED)
+		return makeError(GenericError::NOMEM, "PagePool::grow");
+
+	_chunks.emplace_back(static_cast<byte*>(chunk), ChunkDeleter{mappedSize});
+	return Ok();
+#else
+	return makeError(GenericError::NOMEM, "PagePool::grow");
+#endif
+}
+
+
+kasofs::Result<PagePool::PageId>
+PagePool::allocate() {
+	if (!_freePages.empty()) {
+		auto const id = _freePages.back();
+		_freePages.pop_back();
+		_refCounts[id] = 1;
+
+		return Ok(id);
+	}
+
+	if (_nextPage >= _maxPages) {
+		return makeError(GenericError::NOSPC, "PagePool::allocate");
+	}
+
+	if (_nextPage / kPagesPerChunk >= _chunks.size()) {
+		auto isGrown = grow();
+		if (!isGrown)
+			return isGrown.moveError();
+	}
+
+	auto const id = _nextPage;
+	_nextPage += 1;
+	_refCounts.push_back(1);
+
+	return Ok(id);
+}
+
+
+bool
+PagePool::release(PageId page) {
+	_refCounts[page] -= 1;
+	if (_refCounts[page] > 0)
+		return false;
+
+	_freePages.push_back(page);
+	return true;
+}
@@ -7,24 +7,795 @@
 *  Written by Ivan Ryabov <abbyssoul@gmail.com>
 */
 #include "kasofs/extras/ramfsDriver.hpp"
+#include "kasofs/extras/lzCodec.hpp"
 
 #include <solace/posixErrorDomain.hpp>
 
+#include <algorithm>
+#include <cstring>  // memcpy
+#include <utility>  // std::exchange
+
 
 using namespace kasofs;
 using namespace Solace;
 
 
 VfsNodeType const RamFS::kNodeType{3213};
+VfsNodeType const RamFS::kCacheNodeType{3214};
 
 
 uint32 nodeEpochTime() noexcept {
 	return time(nullptr);
 }
 
+
+namespace /* anonymous */ {
+
+uint64 rotl64(uint64 x, int r) noexcept {
+	return (x << r) | (x >> (64 - r));
+}
+
+uint64 fmix64(uint64 k) noexcept {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+
+/// MurmurHash3 x64 128 bit hash of a memory page. Page size is a multiple of 16 bytes, so there is no tail.
+void hashPage(MemoryView page, uint64& h1, uint64& h2) noexcept {
+	constexpr uint64 c1 = 0x87c37b91114253d5ULL;
+	constexpr uint64 c2 = 0x4cf5ad432745937fULL;
+
+	h1 = 0;
+	h2 = 0;
+	auto const* data = page.dataAddress();
+	for (MemoryView::size_type i = 0; i + 16 <= page.size(); i += 16) {
+		uint64 k1;
+		uint64 k2;
+		memcpy(&k1, data + i, sizeof(k1));
+		memcpy(&k2, data + i + 8, sizeof(k2));
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	h1 ^= page.size();
+	h2 ^= page.size();
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+}
+
+}  // anonymous namespace
+
+
+kasofs::Result<void>
+RamFS::reserve(FileData& data, uint64 size, uint64 writeOffset) {
+	auto const nPages = pagesFor(size);
+	auto const nReserved = data.pages.size();
+	if (nPages <= nReserved)
+		return Ok();
+
+	if (nPages - nReserved > pagesAvailable() && !evict(nPages - nReserved, &data))
+		return makeError(GenericError::NOSPC, "RamFS::reserve");
+
+	// Grow geometrically, so that appending to a file page by page does not copy the list of its pages every time
+	data.pages.reserve(std::max<std::size_t>(nPages, 2 * data.pages.capacity()));
+	while (data.pages.size() < nPages) {
+		auto maybePage = _pool.allocate();
+		if (!maybePage) {  // Give back pages allocated so far: their content is not initialized
+			for (auto i = nReserved; i < data.pages.size(); ++i) {
+				_pool.release(data.pages[i]);
+			}
+			data.pages.resize(nReserved);
+
+			return maybePage.moveError();
+		}
+
+		// Pages are reused so a page may have data of another file: zero what is not about to be written
+		auto page = _pool.page(*maybePage);
+		auto const pageStart = static_cast<uint64>(data.pages.size()) * PagePool::kPageSize;
+		auto const writeBegin = std::min<uint64>(std::max(writeOffset, pageStart) - pageStart, PagePool::kPageSize);
+		auto const writeEnd = std::min<uint64>(size - pageStart, PagePool::kPageSize);
+		if (writeBegin >= writeEnd) {
+			page.fill(0);
+		} else {
+			memset(page.dataAddress(), 0, writeBegin);
+			memset(page.dataAddress(writeEnd), 0, PagePool::kPageSize - writeEnd);
+		}
+
+		data.pages.push_back(*maybePage);
+	}
+
+	return Ok();
+}
+
+
+void
+RamFS::touch(FileData& data) noexcept {
+	if (!data.isEvictable || _mostRecent == &data)
+		return;
+
+	unlink(data);
+	data.older = _mostRecent;
+	if (_mostRecent) {
+		_mostRecent->newer = &data;
+	}
+
+	_mostRecent = &data;
+	if (!_leastRecent) {
+		_leastRecent = &data;
+	}
+}
+
+
+void
+RamFS::unlink(FileData& data) noexcept {
+	if (data.newer) {
+		data.newer->older = data.older;
+	} else if (_mostRecent == &data) {
+		_mostRecent = data.older;
+	}
+
+	if (data.older) {
+		data.older->newer = data.newer;
+	} else if (_leastRecent == &data) {
+		_leastRecent = data.newer;
+	}
+
+	data.newer = nullptr;
+	data.older = nullptr;
+}
+
+
+bool
+RamFS::evict(uint64 nPages, FileData const* exclude) {
+	auto data = _leastRecent;
+	while (data && pagesAvailable() < nPages) {
+		auto const next = data->newer;
+		if (data->pages.empty() && !data->adopted) {  // Nothing to evict until the data is accessed again
+			unlink(*data);
+		} else if (!data->isPinned() && data != exclude) {
+			_stats.evictions += 1;
+			_stats.bytesReclaimed += releasePages(*data) * PagePool::kPageSize;
+			unlink(*data);
+			if (data->nodeId) {  // Size recorded in the node is out of date until the Vfs publishes it
+				_changedNodes.push_back(*data->nodeId);
+				_hasChangedNodes.store(true, std::memory_order_release);
+			}
+		}
+
+		data = next;
+	}
+
+	return (pagesAvailable() >= nPages);
+}
+
+
+RamFS::size_type
+RamFS::copyOut(FileData const& data, size_type offset, MutableMemoryView dest) const noexcept {
+	auto const endOffset = std::min<uint64>(data.storedSize(), static_cast<uint64>(offset) + dest.size());
+	if (data.adopted) {
+		auto const readSize = static_cast<size_type>(std::max<uint64>(endOffset, offset) - offset);
+		memcpy(dest.dataAddress(), data.adopted->data() + offset, readSize);
+		return readSize;
+	}
+
+	size_type totalRead = 0;
+	while (offset + totalRead < endOffset) {
+		auto const position = offset + totalRead;
+		auto const pageOffset = position % PagePool::kPageSize;
+		auto const chunkSize = static_cast<size_type>(std::min<uint64>(PagePool::kPageSize - pageOffset,
+																	 endOffset - position));
+
+		auto page = _pool.page(data.pages[position / PagePool::kPageSize]);
+		memcpy(dest.dataAddress(totalRead), page.dataAddress(pageOffset), chunkSize);
+		totalRead += chunkSize;
+	}
+
+	return totalRead;
+}
+
+
+void
+RamFS::copyIn(FileData& data, size_type offset, MemoryView src) noexcept {
+	size_type totalWritten = 0;
+	while (totalWritten < src.size()) {
+		auto const position = offset + totalWritten;
+		auto const pageOffset = position % PagePool::kPageSize;
+		auto const chunkSize = std::min<size_type>(PagePool::kPageSize - pageOffset, src.size() - totalWritten);
+
+		auto page = _pool.page(data.pages[position / PagePool::kPageSize]);
+		memcpy(page.dataAddress(pageOffset), src.dataAddress(totalWritten), chunkSize);
+		totalWritten += chunkSize;
+	}
+}
+
+
+uint64
+RamFS::releasePages(FileData& data) {
+	capture(data);
+
+	uint64 nReleased = 0;
+	for (auto page : data.pages) {
+		nReleased += releasePage(page) ? 1 : 0;
+	}
+
+	if (data.adopted) {
+		nReleased += (data.adopted.use_count() == 1) ? pagesFor(data.adopted->size()) : 0;
+		data.adopted.reset();
+	}
+
+	data.pages.clear();
+	data.size = 0;
+	data.compressedSize = 0;
+
+	return nReleased;
+}
+
+
+bool
+RamFS::releasePage(PagePool::PageId page) {
+	if (!_pool.release(page))
+		return false;
+
+	auto it = _indexedPages.find(page);
+	if (it != _indexedPages.end()) {
+		_pageIndex.erase(it->second);
+		_indexedPages.erase(it);
+	}
+
+	return true;
+}
+
+
+void
+RamFS::releaseRetired(FileData& data) {
+	if (data.isPinned())
+		return;
+
+	for (auto page : data.retired) {
+		releasePage(page);
+	}
+	data.retired.clear();
+	data.retiredAdopted.reset();
+}
+
+
+void
+RamFS::retire(FileData& data, PagePool::PageId page) {
+	if (data.isPinned()) {  // A borrowed view may point to the page
+		data.retired.push_back(page);
+	} else {
+		releasePage(page);
+	}
+}
+
+
+kasofs::Result<void>
+RamFS::prepareWrite(FileData& data, uint64 offset, uint64 size) {
+	auto isMaterialized = materialize(data);
+	if (!isMaterialized)
+		return isMaterialized;
+
+	capture(data);
+
+	auto isReserved = reserve(data, offset + size, offset);
+	if (!isReserved || size == 0)
+		return isReserved;
+
+	auto const firstPage = offset / PagePool::kPageSize;
+	auto const lastPage = (offset + size - 1) / PagePool::kPageSize;
+
+	uint64 nShared = 0;
+	for (auto i = firstPage; i <= lastPage; ++i) {
+		nShared += (_pool.refCount(data.pages[i]) > 1) ? 1 : 0;
+	}
+
+	if (nShared > pagesAvailable() && !evict(nShared, &data))
+		return makeError(GenericError::NOSPC, "RamFS::prepareWrite");
+
+	for (auto i = firstPage; i <= lastPage; ++i) {
+		auto const page = data.pages[i];
+		if (_pool.refCount(page) == 1) {  // Page is about to change, so it can no longer be shared
+			auto it = _isDedupEnabled
+					? _indexedPages.find(page)
+					: _indexedPages.end();
+			if (it != _indexedPages.end()) {
+				_pageIndex.erase(it->second);
+				_indexedPages.erase(it);
+			}
+			continue;
+		}
+
+		auto maybePage = _pool.allocate();
+		if (!maybePage)
+			return maybePage.moveError();
+
+		memcpy(_pool.page(*maybePage).dataAddress(), _pool.page(page).dataAddress(), PagePool::kPageSize);
+		data.pages[i] = *maybePage;
+		retire(data, page);
+		_stats.copiesOnWrite += 1;
+	}
+
+	return Ok();
+}
+
+
+void
+RamFS::deduplicate(FileData& data, uint64 offset, uint64 size) {
+	if (!_isDedupEnabled || data.isCompressed())
+		return;
+
+	// Only full pages are shared, as the last page of a file is likely to be appended to
+	auto const endPage = std::min<uint64>((offset + size + PagePool::kPageSize - 1) / PagePool::kPageSize,
+										  data.size / PagePool::kPageSize);
+	for (auto i = offset / PagePool::kPageSize; i < endPage; ++i) {
+		auto const page = data.pages[i];
+		if (_indexedPages.find(page) != _indexedPages.end())
+			continue;
+
+		auto content = _pool.page(page);
+		PageHash hash;
+		hashPage(content, hash.low, hash.high);
+
+		auto it = _pageIndex.find(hash);
+		if (it == _pageIndex.end()) {
+			_pageIndex.emplace(hash, page);
+			_indexedPages.emplace(page, hash);
+			continue;
+		}
+
+		auto const sharedPage = it->second;
+		if (0 != memcmp(_pool.page(sharedPage).dataAddress(), content.dataAddress(), content.size()))
+			continue;  // Hash collision
+
+		_pool.share(sharedPage);
+		data.pages[i] = sharedPage;
+		retire(data, page);
+		_stats.sharedPages += 1;
+	}
+}
+
+
+RamFS::FileData*
+RamFS::findData(INode& node) noexcept {
+	auto it = _dataStore.find(node.vfsData);
+	if (it == _dataStore.end())
+		return nullptr;
+
+	auto& data = it->second;
+	touch(data);
+	data.accessTime = nodeEpochTime();
+	if (node.dataSize != data.size) {  // Content was evicted since the node was last accessed
+		node.dataSize = data.size;
+	}
+
+	return &data;
+}
+
+
+bool
+RamFS::compress(FileData& data) {
+	if (data.isCompressed() || data.isPinned() || data.pages.size() < 2)
+		return false;
+
+	// Shared pages are not released when data is compressed, so compressing them would only use more memory
+	auto const isShared = std::any_of(data.pages.begin(), data.pages.end(), [this](PagePool::PageId page) {
+		return _pool.refCount(page) > 1;
+	});
+	if (isShared || hasPendingSnapshots(data))
+		return false;
+
+	std::vector<byte> content(data.size);
+	copyOut(data, 0, wrapMemory(content.data(), content.size()));
+
+	// Compressed content must fit into fewer pages than the original
+	std::vector<byte> compressed((data.pages.size() - 1) * PagePool::kPageSize);
+	auto const compressedSize = LzCodec::compress(wrapMemory(content.data(), content.size()),
+												  wrapMemory(compressed.data(), compressed.size()));
+	if (compressedSize == 0)
+		return false;
+
+	// Compressed copy is stored before the original pages are released, so that content is not lost
+	// if the pool is exhausted. Compression is an optimization and never evicts other content to make room.
+	if (pagesFor(compressedSize) > pagesAvailable())
+		return false;
+
+	FileData compressedData;
+	auto isReserved = reserve(compressedData, compressedSize);
+	if (!isReserved)
+		return false;
+
+	copyIn(compressedData, 0, wrapMemory(compressed.data(), compressedSize));
+
+	auto const size = data.size;
+	releasePages(data);
+	data.pages = mv(compressedData.pages);
+	data.size = size;
+	data.compressedSize = compressedSize;
+
+	data.compressions += 1;
+	_stats.compressions += 1;
+
+	return true;
+}
+
+
+kasofs::Result<void>
+RamFS::decompress(FileData& data) {
+	if (!data.isCompressed())
+		return Ok();
+
+	auto maybeContent = decompressedContent(data);
+	if (!maybeContent)
+		return maybeContent.moveError();
+
+	auto const& content = *maybeContent;
+	auto const compressedSize = data.compressedSize;
+
+	// Keep compressed pages until content is restored, so that it is not lost if the pool is exhausted
+	auto compressedPages = mv(data.pages);
+	data.pages.clear();
+	data.compressedSize = 0;
+
+	auto isReserved = reserve(data, data.size);
+	if (!isReserved) {
+		for (auto page : data.pages) {
+			_pool.release(page);
+		}
+
+		data.pages = mv(compressedPages);
+		data.compressedSize = compressedSize;
+		return isReserved.moveError();
+	}
+
+	copyIn(data, 0, wrapMemory(content.data(), content.size()));
+	for (auto page : compressedPages) {
+		_pool.release(page);
+	}
+	deduplicate(data, 0, data.size);
+
+	data.decompressions += 1;
+	_stats.decompressions += 1;
+
+	return Ok();
+}
+
+
+kasofs::Result<RamFS::Buffer>
+RamFS::decompressedContent(FileData const& data) const {
+	Buffer compressed(data.compressedSize);
+	copyOut(data, 0, wrapMemory(compressed.data(), compressed.size()));
+
+	Buffer content(data.size);
+	auto maybeDecompressed = LzCodec::decompress(wrapMemory(compressed.data(), compressed.size()),
+												 wrapMemory(content.data(), content.size()));
+	if (!maybeDecompressed)
+		return maybeDecompressed.moveError();
+
+	return Ok(mv(content));
+}
+
+
+Optional<RamFS::DataStats>
+RamFS::dataStats(INode const& node) const {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	auto it = _dataStore.find(node.vfsData);
+	if (it == _dataStore.end())
+		return none;
+
+	auto const& data = it->second;
+	DataStats stats;
+	stats.size = data.size;
+	stats.storedBytes = static_cast<uint64>(data.pages.size()) * PagePool::kPageSize +
+			(data.adopted ? data.adopted->size() : 0);
+	stats.isCompressed = data.isCompressed();
+	stats.compressions = data.compressions;
+	stats.decompressions = data.decompressions;
+
+	return stats;
+}
+
+
+kasofs::Result<void>
+RamFS::materialize(FileData& data) {
+	if (!data.adopted)
+		return Ok();
+
+	// Adopted buffer is kept until its content is copied, so that it is not lost if the pool is exhausted
+	auto adopted = mv(data.adopted);
+	data.adopted.reset();
+
+	// Buffer is released once copied, unless a snapshot or a borrowed view still refers to it,
+	// so its capacity is lent to the pages replacing it rather than counted twice
+	auto const credit = (adopted.use_count() == 1 && !data.isPinned()) ? pagesFor(adopted->size()) : 0;
+	_adoptedPages -= credit;
+
+	auto isReserved = reserve(data, adopted->size());
+	_adoptedPages += credit;  // Returned to the buffer to be released by its deleter
+	if (!isReserved) {
+		for (auto page : data.pages) {
+			_pool.release(page);
+		}
+		data.pages.clear();
+		data.adopted = mv(adopted);
+
+		return isReserved.moveError();
+	}
+
+	copyIn(data, 0, wrapMemory(adopted->data(), adopted->size()));
+	if (data.isPinned()) {  // A borrowed view may point into the buffer
+		data.retiredAdopted = mv(adopted);
+	}
+
+	return Ok();
+}
+
+
+kasofs::Result<void>
+RamFS::adopt(INode& node, Buffer&& buffer) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	if (!isRamNode(node)) {
+		return makeError(GenericError::NXIO, "RamFs::adopt");
+	}
+
+	auto data = findData(node);
+	if (!data)
+		return makeError(GenericError::BADF, "RamFS::adopt");
+
+	if (data->isPinned())
+		return makeError(GenericError::BUSY, "RamFS::adopt");
+
+	auto const nPages = pagesFor(buffer.size());
+	if (nPages > pagesAvailable() && !evict(nPages, data))
+		return makeError(GenericError::NOSPC, "RamFS::adopt");
+
+	releasePages(*data);
+
+	// Capacity taken by the buffer is returned once the last reference to it, possibly from a snapshot, is gone
+	_adoptedPages += nPages;
+	data->adopted = std::shared_ptr<Buffer const>{new Buffer{mv(buffer)}, [this, nPages](Buffer const* adopted) {
+		_adoptedPages -= nPages;
+		delete adopted;
+	}};
+	data->size = static_cast<size_type>(data->adopted->size());
+
+	node.dataSize = data->size;
+	node.mtime = nodeEpochTime();
+
+	return Ok();
+}
+
+
+void
+RamFS::capture(FileData& data) {
+	for (auto& weakImage : data.snapshots) {
+		auto image = weakImage.lock();
+		if (!image || image->isCaptured)
+			continue;
+
+		for (auto page : data.pages) {
+			_pool.share(page);
+		}
+
+		image->data.pages = data.pages;
+		image->data.adopted = data.adopted;
+		image->data.size = data.size;
+		image->data.compressedSize = data.compressedSize;
+		image->isCaptured = true;
+	}
+
+	data.snapshots.clear();
+}
+
+
+bool
+RamFS::hasPendingSnapshots(FileData const& data) noexcept {
+	return std::any_of(data.snapshots.begin(), data.snapshots.end(), [](std::weak_ptr<SnapshotImage> const& image) {
+		return !image.expired();
+	});
+}
+
+
+RamFS::Snapshot
+RamFS::snapshot() {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	Snapshot result{this};
+	result._images.reserve(_dataStore.size());
+
+	for (auto& entry : _dataStore) {
+		auto& data = entry.second;
+		data.snapshots.erase(std::remove_if(data.snapshots.begin(), data.snapshots.end(),
+											[](std::weak_ptr<SnapshotImage> const& image) { return image.expired(); }),
+							 data.snapshots.end());
+
+		auto image = std::make_shared<SnapshotImage>();
+		data.snapshots.push_back(image);
+		result._images.emplace(entry.first, mv(image));
+	}
+
+	return result;
+}
+
+
+RamFS::Snapshot::~Snapshot() {
+	release();
+}
+
+
+RamFS::Snapshot::Snapshot(Snapshot&& rhs) noexcept
+	: _fs{std::exchange(rhs._fs, nullptr)}
+	, _images{mv(rhs._images)}
+{
+}
+
+
+RamFS::Snapshot&
+RamFS::Snapshot::operator= (Snapshot&& rhs) noexcept {
+	if (this != &rhs) {
+		release();
+
+		_fs = std::exchange(rhs._fs, nullptr);
+		_images = mv(rhs._images);
+	}
+
+	return *this;
+}
+
+
+void
+RamFS::Snapshot::release() noexcept {
+	if (!_fs)
+		return;
+
+	std::lock_guard<std::mutex> lock{_fs->_mutex};
+	for (auto& entry : _images) {
+		auto const& image = *entry.second;
+		_fs->_adoptedPages -= pagesFor(image.content.size());
+		if (!image.isCaptured)
+			continue;
+
+		for (auto page : image.data.pages) {
+			_fs->releasePage(page);
+		}
+	}
+
+	_images.clear();
+	_fs = nullptr;
+}
+
+
+RamFS::FileData const*
+RamFS::Snapshot::findData(INode const& node) const {
+	auto it = _images.find(node.vfsData);
+	if (it == _images.end())
+		return nullptr;
+
+	auto const& image = *it->second;
+	return image.isCaptured
+			? &image.data
+			: _fs->findData(node);  // Content has not changed since the snapshot was taken
+}
+
+
+Optional<RamFS::size_type>
+RamFS::Snapshot::size(INode const& node) const {
+	std::lock_guard<std::mutex> lock{_fs->_mutex};
+
+	auto data = findData(node);
+	if (!data)
+		return none;
+
+	return data->size;
+}
+
+
+kasofs::Result<RamFS::size_type>
+RamFS::Snapshot::read(INode const& node, size_type offset, MutableMemoryView dest) const {
+	std::lock_guard<std::mutex> lock{_fs->_mutex};
+
+	auto data = findData(node);
+	if (!data)
+		return makeError(GenericError::NOENT, "RamFS::Snapshot::read");
+
+	if (offset > data->size)
+		return makeError(BasicError::Overflow, "RamFS::Snapshot::read");
+
+	if (!data->isCompressed())
+		return Ok(_fs->copyOut(*data, offset, dest));
+
+	auto& image = *_images.find(node.vfsData)->second;  // Data is only found for nodes that have an image
+	if (image.content.empty()) {  // Decompress once, so that reading in chunks does not decompress for every chunk
+		auto const nPages = pagesFor(data->size);
+		if (nPages > _fs->pagesAvailable() && !_fs->evict(nPages, data))
+			return makeError(GenericError::NOSPC, "RamFS::Snapshot::read");
+
+		auto maybeContent = _fs->decompressedContent(*data);
+		if (!maybeContent)
+			return maybeContent.moveError();
+
+		image.content = maybeContent.moveResult();
+		_fs->_adoptedPages += nPages;
+	}
+
+	auto const readSize = std::min<size_type>(dest.size(), data->size - offset);
+	memcpy(dest.dataAddress(), image.content.data() + offset, readSize);
+
+	return Ok(readSize);
+}
+
+
+kasofs::Result<std::vector<uint64>>
+RamFS::pageOffsets(INode& node) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	if (!isRamNode(node)) {
+		return makeError(GenericError::NXIO, "RamFs::pageOffsets");
+	}
+
+	if (_pool.fd() < 0)
+		return makeError(GenericError::NODEV, "RamFS::pageOffsets");
+
+	auto data = findData(node);
+	if (!data)
+		return makeError(GenericError::BADF, "RamFS::pageOffsets");
+
+	auto isDecompressed = decompress(*data);
+	if (!isDecompressed)
+		return isDecompressed.moveError();
+
+	auto isMaterialized = materialize(*data);
+	if (!isMaterialized)
+		return isMaterialized.moveError();
+
+	std::vector<uint64> offsets;
+	offsets.reserve(data->pages.size());
+	for (auto page : data->pages) {
+		offsets.push_back(_pool.fileOffset(page));
+	}
+
+	return Ok(mv(offsets));
+}
+
+
+uint32
+RamFS::compressIdle(uint32 maxIdleSeconds) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	auto const now = nodeEpochTime();
+
+	uint32 count = 0;
+	for (auto& entry : _dataStore) {
+		auto& data = entry.second;
+		if (now - data.accessTime >= maxIdleSeconds && compress(data)) {
+			count += 1;
+		}
+	}
+
+	return count;
+}
+
+
 kasofs::Result<INode>
 RamFS::createNode(NodeType type, User owner, FilePermissions perms) {
-	if (kNodeType != type) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	if (kNodeType != type && kCacheNodeType != type) {
 		return makeError(GenericError::NXIO, "RamFs::createNode");
 	}
 
@@ -33,7 +804,11 @@ RamFS::createNode(NodeType type, User owner, FilePermissions perms) {
 	node.vfsData = nextId();
 	node.atime = nodeEpochTime();
 	node.mtime = nodeEpochTime();
-	_dataStore.emplace(node.vfsData, Buffer{});
+
+	FileData data;
+	data.isEvictable = (kCacheNodeType == type);
+	auto inserted = _dataStore.emplace(node.vfsData, mv(data));
+	touch(inserted.first->second);
 
 	return mv(node);
 }
@@ -41,83 +816,276 @@ RamFS::createNode(NodeType type, User owner, FilePermissions perms) {
 
 kasofs::Result<void>
 RamFS::destroyNode(INode& node) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
 	if (!isRamNode(node)) {
 		return makeError(GenericError::NXIO, "RamFs::destroyNode");
 	}
 
+	auto data = findData(node);
+	if (!data)
+		return Ok();
+
+	if (data->isPinned())  // Pages can not be reused while there are borrowed views of them
+		return makeError(GenericError::BUSY, "RamFs::destroyNode");
+
+	releasePages(*data);
+	unlink(*data);
 	_dataStore.erase(node.vfsData);
 	return Ok();
 }
 
 
+RamFS::size_type
+RamFS::dataSize(INode const& node) const {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	auto data = findData(node);
+	return data
+			? data->size
+			: node.dataSize;
+}
+
+
+void
+RamFS::bindNode(INode const& node, INode::Id id) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	auto data = findData(node);
+	if (data) {
+		data->nodeId = id;
+	}
+}
+
+
+std::vector<INode::Id>
+RamFS::takeChangedNodes() {
+	if (!_hasChangedNodes.load(std::memory_order_acquire))
+		return {};
+
+	std::lock_guard<std::mutex> lock{_mutex};
+	_hasChangedNodes.store(false, std::memory_order_relaxed);
+	return std::exchange(_changedNodes, {});
+}
+
+
 kasofs::Result<Filesystem::OpenFID>
 RamFS::open(INode& node, Permissions) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
 	if (!isRamNode(node)) {
 		return makeError(GenericError::NXIO, "RamFs::open");
 	}
 
+	findData(node);  // Opening a node counts as an access for eviction order
 	node.atime = nodeEpochTime();
-	return Ok<OpenFID>(0);
+	return Ok(_nextFid++);
 }
 
 
 kasofs::Result<RamFS::size_type>
 RamFS::read(OpenFID, INode& node, size_type offset, MutableMemoryView dest) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
 	if (!isRamNode(node)) {
 		return makeError(GenericError::NXIO, "RamFs::read");
 	}
 
-	auto const id = node.vfsData;
-	auto it = _dataStore.find(id);
-	if (it == _dataStore.end())
+	auto data = findData(node);
+	if (!data)
 		return makeError(GenericError::BADF, "RamFS::read");
 
-	auto& buffer = it->second;
-	if (offset > buffer.size())
-		return makeError(BasicError::Overflow, "RamFS::read");
+	auto isDecompressed = decompress(*data);
+	if (!isDecompressed)
+		return isDecompressed.moveError();
 
-	auto data = wrapMemory(buffer.data() + offset, buffer.size() - offset).slice(0, dest.size());
-	auto isOk = dest.write(data);
-	if (!isOk) {
-		return isOk.moveError();
+	if (offset > data->size) {
+		if (data->isEvictable)  // Content may have been evicted since the reader learned its size
+			return Ok<size_type>(0);
+
+		return makeError(BasicError::Overflow, "RamFS::read");
 	}
 
-	return Ok(data.size());
+	return Ok(copyOut(*data, offset, dest));
 }
 
 
 kasofs::Result<Filesystem::size_type>
 RamFS::write(OpenFID, INode& node, size_type offset, MemoryView src) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
 	if (!isRamNode(node)) {
 		return makeError(GenericError::NXIO, "RamFs::write");
 	}
 
-	auto const id = node.vfsData;
-	auto it = _dataStore.find(id);
-	if (it == _dataStore.end())
+	auto data = findData(node);
+	if (!data)
 		return makeError(GenericError::BADF, "RamFs::write");
 
-	auto& buffer = it->second;
-	if (offset > buffer.size())
+	auto isDecompressed = decompress(*data);
+	if (!isDecompressed)
+		return isDecompressed.moveError();
+
+	if (offset > data->size)
 		return makeError(BasicError::Overflow, "RamFs::write");
 
-	auto const newSize = offset + src.size();
-	/// FIXME: Use fixed size pool
-	buffer.reserve(newSize);
+	auto isPrepared = prepareWrite(*data, offset, src.size());
+	if (!isPrepared)
+		return isPrepared.moveError();
+
+	copyIn(*data, offset, src);
+	data->size = std::max<size_type>(data->size, offset + src.size());
+	deduplicate(*data, offset, src.size());
+
+	node.dataSize = data->size;
+	node.mtime = nodeEpochTime();
+
+	return Ok(src.size());
+}
+
+
+kasofs::Result<RamFS::size_type>
+RamFS::readv(OpenFID, INode& node, size_type offset, ArrayView<MutableMemoryView const> dest) {
+	std::lock_guard<std::mutex> lock{_mutex};
 
-	if (buffer.size() < newSize) {
-		buffer.resize(newSize);
+	if (!isRamNode(node)) {
+		return makeError(GenericError::NXIO, "RamFs::readv");
 	}
-	auto writeResult = wrapMemory(buffer.data(), buffer.size())
-			.write(src, offset);
 
-	if (!writeResult)
-		return writeResult.moveError();
+	auto data = findData(node);
+	if (!data)
+		return makeError(GenericError::BADF, "RamFS::readv");
+
+	auto isDecompressed = decompress(*data);
+	if (!isDecompressed)
+		return isDecompressed.moveError();
+
+	if (offset > data->size) {
+		if (data->isEvictable)  // Content may have been evicted since the reader learned its size
+			return Ok<size_type>(0);
+
+		return makeError(BasicError::Overflow, "RamFS::readv");
+	}
+
+	size_type totalRead = 0;
+	for (auto destBuffer : dest) {
+		auto const position = offset + totalRead;
+		if (position == data->size)
+			break;
+
+		totalRead += copyOut(*data, position, destBuffer);
+	}
+
+	return Ok(totalRead);
+}
 
-	node.dataSize = buffer.size();
+
+kasofs::Result<RamFS::size_type>
+RamFS::writev(OpenFID, INode& node, size_type offset, ArrayView<MemoryView const> src) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	if (!isRamNode(node)) {
+		return makeError(GenericError::NXIO, "RamFs::writev");
+	}
+
+	auto data = findData(node);
+	if (!data)
+		return makeError(GenericError::BADF, "RamFs::writev");
+
+	auto isDecompressed = decompress(*data);
+	if (!isDecompressed)
+		return isDecompressed.moveError();
+
+	if (offset > data->size)
+		return makeError(BasicError::Overflow, "RamFs::writev");
+
+	uint64 totalSize = 0;
+	for (auto const& srcBuffer : src) {
+		totalSize += srcBuffer.size();
+	}
+
+	// Prepare pages once for the whole batch
+	auto isPrepared = prepareWrite(*data, offset, totalSize);
+	if (!isPrepared)
+		return isPrepared.moveError();
+
+	size_type totalWritten = 0;
+	for (auto const& srcBuffer : src) {
+		copyIn(*data, offset + totalWritten, srcBuffer);
+		totalWritten += srcBuffer.size();
+	}
+	data->size = std::max<size_type>(data->size, offset + totalWritten);
+	deduplicate(*data, offset, totalWritten);
+
+	node.dataSize = data->size;
 	node.mtime = nodeEpochTime();
 
-	return Ok(src.size());
+	return Ok(totalWritten);
+}
+
+
+kasofs::Result<MemoryView>
+RamFS::borrow(OpenFID streamId, INode& node, size_type offset, size_type size) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	if (!isRamNode(node)) {
+		return makeError(GenericError::NXIO, "RamFs::borrow");
+	}
+
+	auto data = findData(node);
+	if (!data)
+		return makeError(GenericError::BADF, "RamFS::borrow");
+
+	auto isDecompressed = decompress(*data);
+	if (!isDecompressed)
+		return isDecompressed.moveError();
+
+	if (offset > data->size && !data->isEvictable)
+		return makeError(BasicError::Overflow, "RamFS::borrow");
+
+	if (offset >= data->size || size == 0)  // Nothing to borrow at the end of file, or past it if content was evicted
+		return Ok(MemoryView{});
+
+	MemoryView view;
+	if (data->adopted) {  // Adopted buffer is contiguous
+		view = wrapMemory(data->adopted->data() + offset, data->size - offset).slice(0, size);
+	} else {  // A borrowed view never crosses a page boundary as pages are not contiguous
+		auto const pageOffset = offset % PagePool::kPageSize;
+		auto const viewSize = std::min<size_type>({size, PagePool::kPageSize - pageOffset, data->size - offset});
+		auto page = _pool.page(data->pages[offset / PagePool::kPageSize]);
+		view = page.slice(pageOffset, pageOffset + viewSize);
+	}
+
+	data->borrows.push_back({streamId, view.dataAddress()});
+	return Ok(view);
+}
+
+
+kasofs::Result<void>
+RamFS::release(OpenFID streamId, INode const& node, MemoryView view) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
+	if (!isRamNode(node)) {
+		return makeError(GenericError::NXIO, "RamFs::release");
+	}
+
+	if (view.empty())  // Empty views are not pinned
+		return Ok();
+
+	auto data = findData(node);
+	if (!data)
+		return makeError(GenericError::INVAL, "RamFS::release");
+
+	auto it = std::find_if(data->borrows.begin(), data->borrows.end(), [streamId, view](Borrow const& borrow) {
+		return borrow.fid == streamId && borrow.address == view.dataAddress();
+	});
+	if (it == data->borrows.end())  // View was not borrowed by the file or has already been released
+		return makeError(GenericError::INVAL, "RamFS::release");
+
+	data->borrows.erase(it);
+	releaseRetired(*data);
+
+	return Ok();
 }
 
 
@@ -137,10 +1105,22 @@ RamFS::seek(OpenFID, INode& node, size_type offset, SeekDirection direction) {
 
 
 kasofs::Result<void>
-RamFS::close(OpenFID, INode& node) {
+RamFS::close(OpenFID streamId, INode& node) {
+	std::lock_guard<std::mutex> lock{_mutex};
+
 	if (!isRamNode(node)) {
 		return makeError(GenericError::NXIO, "RamFs::close");
 	}
 
+	auto data = findData(static_cast<INode const&>(node));
+	if (!data)
+		return Ok();
+
+	// Views the file has not released are no longer valid once it is closed
+	data->borrows.erase(std::remove_if(data->borrows.begin(), data->borrows.end(), [streamId](Borrow const& borrow) {
+		return borrow.fid == streamId;
+	}), data->borrows.end());
+	releaseRetired(*data);
+
 	return Ok();
 }
@@ -11,9 +11,10 @@
 
 
 #include <solace/posixErrorDomain.hpp>
-#include <solace/unit.hpp>
 
 
+#include <algorithm>
+#include <ctime>
 #include <functional>
 
 
@@ -21,43 +22,185 @@ using namespace kasofs;
 using namespace Solace;
 
 
+namespace /* anonymous */ {
+
+uint32 epochTime() noexcept {
+	return static_cast<uint32>(time(nullptr));
+}
+
+}  // namespace
+
+
+template<typename F>
+auto
+File::withNodeForIO(F&& f) {
+	Optional<decltype(f(_privateNode))> result;
+	if (_policy.sync == MetadataPolicy::Sync::WriteBack) {
+		std::lock_guard<std::mutex> lock{_lock};
+		_isDirty = true;
+		result = f(_privateNode);
+	} else {
+		result = _vfs->modifyOpenNode(_nodeId, std::forward<F>(f));
+	}
+
+	_vfs->publishChangedNodes(*_fs);  // Driver may have changed other nodes to make room for the operation
+	return result;
+}
+
+
+template<typename F>
+auto
+File::withNodeForRead(F&& f) {
+	std::unique_lock<std::mutex> lock{_lock};
+	auto node = _privateNode;
+	lock.unlock();
+
+	Optional<decltype(f(node))> result;
+	if (_policy.sync == MetadataPolicy::Sync::WriteBack) {
+		result = f(node);
+	} else {  // Shared access does not bump version of the node, unlike a modification
+		result = _vfs->withOpenNode(_nodeId, [&node, &f](INode const& openNode) {
+			node = openNode;
+			return f(node);
+		});
+	}
+
+	if (result && *result && touchAccessTime(node)) {
+		auto const atime = node.atime;
+		if (_policy.sync == MetadataPolicy::Sync::WriteBack) {
+			lock.lock();
+			_privateNode.atime = std::max(_privateNode.atime, atime);
+			_isDirty = true;
+			lock.unlock();
+		} else {
+			_vfs->modifyOpenNode(_nodeId, [atime](INode& openNode) {
+				openNode.atime = std::max(openNode.atime, atime);
+				return true;
+			});
+		}
+	}
+
+	_vfs->publishChangedNodes(*_fs);  // Driver may have changed other nodes to make room for the operation
+	return result;
+}
+
+
+bool
+File::touchAccessTime(INode& node) const noexcept {
+	auto const now = epochTime();
+	switch (_policy.atime) {
+	case MetadataPolicy::AccessTime::Strict:
+		break;
+	case MetadataPolicy::AccessTime::Relative:
+		if (node.atime > node.mtime && now - node.atime < MetadataPolicy::kRelativeAccessTimeAge) {
+			return false;
+		}
+		break;
+	case MetadataPolicy::AccessTime::None:
+		return false;
+	}
+
+	if (node.atime == now)
+		return false;
+
+	node.atime = now;
+	return true;
+}
+
+
 File::~File() {
 	if (_vfs) {
-		_vfs->findFs(_cachedNode.fsTypeId)
-				.flatMap([this](Filesystem* fs) -> Optional<Unit> {
-					fs->close(_fid, _cachedNode);
-					_vfs->updateNode(_nodeId, _cachedNode);
-					return none;
-				 });
+		withNodeForIO([this](INode& node) {
+			return _fs->close(_fid, node);
+		});
+		flush();
+		_vfs->closeFile(_nodeId, _fsTypeId);
 	}
 }
 
+
 void File::flush() {
-	if (_vfs) {
-		_vfs->updateNode(_nodeId, _cachedNode);
-	}
+	if (!_vfs)
+		return;
+
+	std::unique_lock<std::mutex> lock{_lock};
+	if (!_isDirty)
+		return;
+
+	auto const node = _privateNode;
+	_isDirty = false;
+	lock.unlock();
+
+	// Other files may have changed the node since the private copy was taken: publish only what IO changed
+	_vfs->modifyOpenNode(_nodeId, [this, &node](INode& openNode) {
+		openNode.atime = std::max(openNode.atime, node.atime);
+		openNode.mtime = std::max(openNode.mtime, node.mtime);
+		openNode.dataSize = std::max(openNode.dataSize, node.dataSize);
+		openNode.dataSize = _fs->dataSize(openNode);
+		return true;
+	});
 }
 
 
 kasofs::Result<INode>
 File::stat() const noexcept {
-	return kasofs::Result<INode>{types::okTag, _cachedNode};
+	if (!_vfs)
+		return makeError(GenericError::NODEV, "File::stat");
+
+	std::unique_lock<std::mutex> lock{_lock};
+	auto node = _privateNode;
+	lock.unlock();
+
+	if (_policy.sync != MetadataPolicy::Sync::WriteBack) {
+		auto maybeNode = _vfs->withOpenNode(_nodeId, [](INode const& openNode) { return openNode; });
+		if (!maybeNode) {
+			return makeError(GenericError::BADF, "File::stat");
+		}
+
+		node = *maybeNode;
+	}
+
+	node.dataSize = _fs->dataSize(node);  // Driver may have changed the data since the node was last updated
+	return kasofs::Result<INode>{types::okTag, node};
 }
 
 
 kasofs::Result<File::size_type>
-File::read(MutableMemoryView dest) {
+File::readAt(size_type offset, MutableMemoryView dest) {
+	if (!_vfs)
+		return makeError(GenericError::NODEV, "File::readAt");
+
+	auto maybeResult = withNodeForRead([this, offset, dest](INode& node) {
+		return _fs->read(_fid, node, offset, dest);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::readAt");
+	}
+
+	return maybeResult.move();
+}
+
+
+kasofs::Result<File::size_type>
+File::writeAt(size_type offset, MemoryView src) {
 	if (!_vfs)
-		return makeError(GenericError::NODEV, "File::read");
+		return makeError(GenericError::NODEV, "File::writeAt");
 
-	auto maybeFs = _vfs->findFs(_cachedNode.fsTypeId);
-	if (!maybeFs) {
-		return makeError(GenericError::NXIO, "File::read");
+	auto maybeResult = withNodeForIO([this, offset, src](INode& node) {
+		return _fs->write(_fid, node, offset, src);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::writeAt");
 	}
 
-	return (*maybeFs)->read(_fid, _cachedNode, _readOffset, dest)
+	return maybeResult.move();
+}
+
+
+kasofs::Result<File::size_type>
+File::read(MutableMemoryView dest) {
+	return readAt(_readOffset, dest)
 			.then([this](File::size_type byteTransferred) {
-				_vfs->updateNode(_nodeId, _cachedNode);
 				_readOffset += byteTransferred;
 
 				return byteTransferred;
@@ -67,17 +210,50 @@ File::read(MutableMemoryView dest) {
 
 kasofs::Result<File::size_type>
 File::write(MemoryView src) {
+	return writeAt(_writeOffset, src)
+			.then([this](File::size_type byteTransferred) {
+				_writeOffset += byteTransferred;
+
+				return byteTransferred;
+			});
+}
+
+
+kasofs::Result<File::size_type>
+File::readv(ArrayView<MutableMemoryView const> dest) {
+	if (!_vfs)
+		return makeError(GenericError::NODEV, "File::readv");
+
+	auto maybeResult = withNodeForRead([this, dest](INode& node) {
+		return _fs->readv(_fid, node, _readOffset, dest);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::readv");
+	}
+
+	return maybeResult.move()
+			.then([this](File::size_type byteTransferred) {
+				_readOffset += byteTransferred;
+
+				return byteTransferred;
+			});
+}
+
+
+kasofs::Result<File::size_type>
+File::writev(ArrayView<MemoryView const> src) {
 	if (!_vfs)
-		return makeError(GenericError::NODEV, "File::write");
+		return makeError(GenericError::NODEV, "File::writev");
 
-	auto maybeFs = _vfs->findFs(_cachedNode.fsTypeId);
-	if (!maybeFs) {
-		return makeError(GenericError::NXIO, "File::write");
+	auto maybeResult = withNodeForIO([this, src](INode& node) {
+		return _fs->writev(_fid, node, _writeOffset, src);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::writev");
 	}
 
-	return (*maybeFs)->write(_fid, _cachedNode, _writeOffset, src)
+	return maybeResult.move()
 			.then([this](File::size_type byteTransferred) {
-				_vfs->updateNode(_nodeId, _cachedNode);
 				_writeOffset += byteTransferred;
 
 				return byteTransferred;
@@ -85,14 +261,61 @@ File::write(MemoryView src) {
 }
 
 
+kasofs::Result<MemoryView>
+File::readBorrowed(size_type size) {
+	if (!_vfs)
+		return makeError(GenericError::NODEV, "File::readBorrowed");
+
+	auto maybeResult = withNodeForRead([this, size](INode& node) {
+		return _fs->borrow(_fid, node, _readOffset, size);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::readBorrowed");
+	}
+
+	return maybeResult.move()
+			.then([this](MemoryView view) {
+				_readOffset += view.size();
+
+				return view;
+			});
+}
+
+
+kasofs::Result<void>
+File::releaseBorrowed(MemoryView view) {
+	if (!_vfs)
+		return makeError(GenericError::NODEV, "File::releaseBorrowed");
+
+	if (_policy.sync == MetadataPolicy::Sync::WriteBack) {
+		std::unique_lock<std::mutex> lock{_lock};
+		auto const node = _privateNode;
+		lock.unlock();
+
+		return _fs->release(_fid, node, view);
+	}
+
+	auto maybeResult = _vfs->withOpenNode(_nodeId, [this, view](INode const& node) {
+		return _fs->release(_fid, node, view);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::releaseBorrowed");
+	}
+
+	return maybeResult.move();
+}
+
+
 kasofs::Result<File::size_type>
 File::seekRead(size_type offset, Filesystem::SeekDirection direction) {
-	auto maybeFs = _vfs->findFs(_cachedNode.fsTypeId);
-	if (!maybeFs) {
-		return makeError(GenericError::NXIO, "File::seekWrite");
+	auto maybeResult = withNodeForIO([this, offset, direction](INode& node) {
+		return _fs->seek(_fid, node, offset, direction);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::seekRead");
 	}
 
-	return (*maybeFs)->seek(_fid, _cachedNode, offset, direction)
+	return maybeResult.move()
 			.then([this](File::size_type pos) {
 				_readOffset = pos;
 				return _readOffset;
@@ -102,12 +325,14 @@ File::seekRead(size_type offset, Filesystem::SeekDirection direction) {
 
 kasofs::Result<File::size_type>
 File::seekWrite(size_type offset, Filesystem::SeekDirection direction) {
-	auto maybeFs = _vfs->findFs(_cachedNode.fsTypeId);
-	if (!maybeFs) {
-		return makeError(GenericError::NXIO, "File::seekWrite");
+	auto maybeResult = withNodeForIO([this, offset, direction](INode& node) {
+		return _fs->seek(_fid, node, offset, direction);
+	});
+	if (!maybeResult) {
+		return makeError(GenericError::BADF, "File::seekWrite");
 	}
 
-	return (*maybeFs)->seek(_fid, _cachedNode, offset, direction)
+	return maybeResult.move()
 			.then([this](File::size_type pos) {
 				_writeOffset = pos;
 				return _writeOffset;
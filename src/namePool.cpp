@@ -0,0 +1,120 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+#include "kasofs/namePool.hpp"
+
+#include <cstring>  // memcpy
+#include <string_view>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+std::size_t
+EntryName::hashOf(StringView name) noexcept {
+	return std::hash<std::string_view>{}(std::string_view{name.data(), name.size()});
+}
+
+
+char*
+NamePool::allocate(StringView::size_type size) {
+	if (size == 0)
+		return nullptr;
+
+	auto freeIt = _freeStorage.find(size);
+	if (freeIt != _freeStorage.end() && !freeIt->second.empty()) {
+		auto* data = freeIt->second.back();
+		freeIt->second.pop_back();
+		return data;
+	}
+
+	if (size > kBlockSize) {  // Long names get a dedicated block
+		_blocks.emplace_back(std::make_unique<char[]>(size));
+		_bytesAllocated += size;
+		return _blocks.back().get();
+	}
+
+	if (kBlockSize - _blockOffset < size) {
+		_blocks.emplace_back(std::make_unique<char[]>(kBlockSize));
+		_block = _blocks.back().get();
+		_blockOffset = 0;
+		_bytesAllocated += kBlockSize;
+	}
+
+	auto* data = _block + _blockOffset;
+	_blockOffset += size;
+	return data;
+}
+
+
+NamePool::Handle
+NamePool::intern(StringView name) {
+	auto const key = EntryName{name};
+	auto it = _index.find(key);
+	if (it != _index.end()) {
+		_records[it->second].refCount += 1;
+		return it->second;
+	}
+
+	auto* data = allocate(name.size());
+	if (name.size() > 0) {
+		std::memcpy(data, name.data(), name.size());
+	}
+
+	Handle handle;
+	if (_freeHandles.empty()) {
+		handle = static_cast<Handle>(_records.size());
+		_records.push_back(Record{data, name.size(), 1});
+	} else {
+		handle = _freeHandles.back();
+		_freeHandles.pop_back();
+		_records[handle] = Record{data, name.size(), 1};
+	}
+
+	// Key of the index is a view into the pool's own copy of the name
+	auto storedKey = key;
+	storedKey.name = StringView{data, name.size()};
+	_index.emplace(storedKey, handle);
+
+	return handle;
+}
+
+
+Optional<NamePool::Handle>
+NamePool::find(StringView name) const noexcept {
+	auto it = _index.find(EntryName{name});
+	if (it == _index.end())
+		return none;
+
+	return it->second;
+}
+
+
+void
+NamePool::release(Handle handle) {
+	if (handle >= _records.size())
+		return;
+
+	auto& record = _records[handle];
+	if (record.refCount == 0)
+		return;
+
+	record.refCount -= 1;
+	if (record.refCount > 0)
+		return;
+
+	_index.erase(EntryName{StringView{record.data, record.size}});
+	if (record.size > 0) {
+		_freeStorage[record.size].push_back(record.data);
+	}
+	_freeHandles.push_back(handle);
+
+	record.data = nullptr;
+	record.size = 0;
+}
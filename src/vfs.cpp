@@ -10,6 +10,9 @@
 
 #include <solace/posixErrorDomain.hpp>
 
+#include <algorithm>
+#include <string_view>
+
 
 using namespace kasofs;
 using namespace Solace;
@@ -23,28 +26,141 @@ StringLiteral const Vfs::kParentDir("..");
 Filesystem::~Filesystem() = default;
 
 
+kasofs::Result<Filesystem::size_type>
+Filesystem::readv(OpenFID fid, INode& node, size_type offset, ArrayView<MutableMemoryView const> dest) {
+	size_type totalRead = 0;
+	for (auto const& buffer : dest) {
+		auto result = read(fid, node, offset + totalRead, buffer);
+		if (!result) {
+			if (totalRead > 0)  // Report partial read
+				break;
+
+			return result.moveError();
+		}
+
+		totalRead += *result;
+		if (*result < buffer.size())
+			break;
+	}
+
+	return Ok(totalRead);
+}
+
+
+kasofs::Result<Filesystem::size_type>
+Filesystem::writev(OpenFID fid, INode& node, size_type offset, ArrayView<MemoryView const> src) {
+	size_type totalWritten = 0;
+	for (auto const& buffer : src) {
+		auto result = write(fid, node, offset + totalWritten, buffer);
+		if (!result) {
+			if (totalWritten > 0)  // Report partial write
+				break;
+
+			return result.moveError();
+		}
+
+		totalWritten += *result;
+		if (*result < buffer.size())
+			break;
+	}
+
+	return Ok(totalWritten);
+}
+
+
+Filesystem::size_type
+Filesystem::dataSize(INode const& node) const {
+	return node.dataSize;
+}
+
+
+void
+Filesystem::bindNode(INode const&, INode::Id) {
+}
+
+
+std::vector<INode::Id>
+Filesystem::takeChangedNodes() {
+	return {};
+}
+
+
+kasofs::Result<MemoryView>
+Filesystem::borrow(OpenFID, INode&, size_type, size_type) {
+	return makeError(SystemErrors::NOSYS, "Filesystem::borrow");
+}
+
+
+kasofs::Result<void>
+Filesystem::release(OpenFID, INode const&, MemoryView) {
+	return makeError(SystemErrors::NOSYS, "Filesystem::release");
+}
+
+
 EntriesEnumerator::~EntriesEnumerator() {
-	_vfs.releaseNode(_dirId);
+	if (_vfs) {
+		_vfs->releaseNode(_dirId);
+	}
 }
 
 
-EntriesEnumerator::EntriesEnumerator(Vfs& vfs, INode::Id dirId, Entries const& entries) noexcept
-	: _vfs{vfs}
+EntriesEnumerator::EntriesEnumerator(Vfs& vfs, INode::Id dirId, Entries const& entries)
+	: _vfs{&vfs}
 	, _dirId{dirId}
-	, _entries{entries}
 {
-	_vfs.addNodeLink(_dirId);
+	// Note: Directory is pinned by Vfs::enumerateDirectory, and released once the enumerator is destroyed
+	copyEntries(entries, Entries::kLatest);
+}
+
+
+EntriesEnumerator::EntriesEnumerator(Entries const& entries, Version version)
+	: _vfs{nullptr}
+	, _dirId{0, 0}
+{
+	copyEntries(entries, version);
+}
+
+
+void
+EntriesEnumerator::copyEntries(Entries const& entries, Version version) {
+	std::size_t namesSize = 0;
+	std::size_t nEntries = 0;
+	entries.forEachAt(version, [&namesSize, &nEntries](Entries::Slot const& slot) {
+		namesSize += slot.name.name.size();
+		nEntries += 1;
+	});
+
+	// Storage of names is reserved upfront so that views of the copied names are never invalidated
+	_names.reserve(namesSize);
+	_entries.reserve(nEntries);
+	entries.forEachAt(version, [this](Entries::Slot const& slot) {
+		auto const name = slot.name.name;
+		auto const offset = _names.size();
+		_names.insert(_names.end(), name.data(), name.data() + name.size());
+		_entries.emplace_back(StringView{_names.data() + offset, name.size()}, slot.nodeId);
+	});
+}
+
+
+EntriesEnumerator::EntriesEnumerator(EntriesEnumerator&& rhs) noexcept
+	: _vfs{std::exchange(rhs._vfs, nullptr)}
+	, _dirId{rhs._dirId}
+	, _names{mv(rhs._names)}
+	, _entries{mv(rhs._entries)}
+{
 }
 
 
 
 
 Vfs::Vfs(User owner, FilePermissions rootPerms)
-	: _index{}
-	, _vfs{}
+	: _locks{std::make_unique<Locks>()}
+	, _index{std::make_unique<ChunkedArray<INodeEntry>>()}
+	, _directories{std::make_unique<DirFs>()}
+	, _retired{std::make_unique<EpochReclaimer>()}
+	, _drivers{}
 {
-	_vfs.emplace(DirFs::kTypeId, std::make_unique<DirFs>());
-	_nextId = 1;
+	_drivers.emplace_back(std::make_unique<DirFs>());  // DirFs::kTypeId
 
 	createUnlinkedNode(DirFs::kTypeId, DirFs::kNodeType, owner, rootPerms, FilePermissions{0666})
 			.then([this](INode::Id rootId) {addNodeLink(rootId); });
@@ -53,13 +169,18 @@ Vfs::Vfs(User owner, FilePermissions rootPerms)
 
 kasofs::Result<void>
 Vfs::unregisterFileSystem(VfsId fsId) {
-	// FIXME: Check if fs is busy / in use
-	auto nRemoved = _vfs.erase(fsId);
-	if (!nRemoved) {
+	std::unique_lock<std::shared_mutex> registry{_locks->registry};
+	if (fsId >= _drivers.size() || !_drivers[fsId].fs) {
 		return makeError(GenericError::BADF, "unregisterFileSystem");
-    }
+	}
 
-    return Ok();
+	auto& slot = _drivers[fsId];
+	if (slot.openCount > 0) {
+		return makeError(GenericError::BUSY, "unregisterFileSystem");
+	}
+
+	slot.fs.reset();
+	return Ok();
 }
 
 /*
@@ -105,18 +226,39 @@ Vfs::umount(User user, INode::Id mountingPoint) {
 
 
 
+Vfs::NodesLock
+Vfs::lockNodes(uint32 lhs, uint32 rhs) const {
+	if (isSameLock(lhs, rhs)) {
+		return NodesLock{std::unique_lock<std::shared_mutex>{nodeLock(lhs)}, {}};
+	}
+
+	if (lhs % kLockStripes > rhs % kLockStripes) {
+		std::swap(lhs, rhs);
+	}
+
+	std::unique_lock<std::shared_mutex> first{nodeLock(lhs)};
+	std::unique_lock<std::shared_mutex> second{nodeLock(rhs)};
+
+	return NodesLock{mv(first), mv(second)};
+}
+
+
 kasofs::Result<void>
 Vfs::link(User user, StringView linkName, INode::Id from, INode::Id to) {
     if (from == to) {
 		return makeError(GenericError::BADF, "link:from::to");
     }
 
-    auto maybeNode = nodeById(from);
-    if (!maybeNode) {
+	auto modification = beginModification();
+	auto const nodes = lockNodes(from.index, to.index);
+	assignVersion(modification);
+
+	auto* dirEntry = entryById(from);
+	if (!dirEntry) {
 		return makeError(GenericError::NOENT, "link:from");
-    }
+	}
 
-	auto& dirNode = *maybeNode;
+	auto& dirNode = dirEntry->inode;
 	if (!isDirectory(dirNode)) {
 		return makeError(GenericError::NOTDIR, "link");
     }
@@ -125,16 +267,18 @@ Vfs::link(User user, StringView linkName, INode::Id from, INode::Id to) {
 		return makeError(GenericError::PERM, "link");
     }
 
-	auto maybeTargetNode = nodeById(to);
-	if (!maybeTargetNode) {
+	auto* targetEntry = entryById(to);
+	if (!targetEntry) {
 		return makeError(GenericError::NOENT, "link:to");
-    }
+	}
 
-    // Add new entry:
-	Entry entry{linkName, to};
-	auto result = _directories.addEntry(dirNode, entry);
-	if (result) {  // TODO(abbyssoul): this is a race condition as node could have been changed
-		addNodeLink(to);  // (*maybeTargetNode).nLinks += 1;
+	// Add new entry:
+	auto result = _directories->addEntry(dirNode, Entry{linkName, to}, modification.version);
+	if (result) {
+		targetEntry->inode.nLinks += 1;
+		commit(*targetEntry, to.index, modification);
+		dirNode.version += 1;
+		commit(*dirEntry, from.index, modification);
 	}
 
 	return result;
@@ -143,103 +287,365 @@ Vfs::link(User user, StringView linkName, INode::Id from, INode::Id to) {
 
 kasofs::Result<void>
 Vfs::unlink(User user, INode::Id fromDir, StringView name) {
-	auto maybeDirNode = nodeById(fromDir);
-	if (!maybeDirNode) {
-		return makeError(GenericError::BADF, "unlink");
-    }
+	while (true) {
+		// Peek at the entry first, as both the directory and the node it links to must be locked to unlink it
+		auto const maybePeeked = lookup(fromDir, name);
+		auto const targetIndex = maybePeeked ? (*maybePeeked).nodeId.index : fromDir.index;
+		auto modification = beginModification();
+		auto const nodes = lockNodes(fromDir.index, targetIndex);
+		assignVersion(modification);
+
+		auto* dirEntry = entryById(fromDir);
+		if (!dirEntry) {
+			return makeError(GenericError::BADF, "unlink");
+		}
 
-	auto& dirNode = *maybeDirNode;
-	if (!isDirectory(dirNode)) {
-		return makeError(GenericError::NOTDIR, "unlink");
-    }
+		auto& dirNode = dirEntry->inode;
+		if (!isDirectory(dirNode)) {
+			return makeError(GenericError::NOTDIR, "unlink");
+		}
 
-	if (!dirNode.userCan(user, Permissions::WRITE)) {
-		return makeError(GenericError::PERM, "unlink");
-    }
+		if (!dirNode.userCan(user, Permissions::WRITE)) {
+			return makeError(GenericError::PERM, "unlink");
+		}
 
-	auto maybeEntry = _directories.lookup(dirNode, name);
-	if (!maybeEntry)  // No entry - no-op.
-		return Ok();
+		auto maybeEntry = _directories->lookup(dirNode, name);
+		if (!maybeEntry)  // No entry - no-op.
+			return Ok();
+
+		auto const targetId = (*maybeEntry).nodeId;
+		if (!isSameLock(targetId.index, targetIndex)) {  // Name has been re-linked since it was peeked at
+			continue;
+		}
 
-	auto& entry = *maybeEntry;
-	auto maybeTargetNode = nodeById(entry.nodeId);
-	if (maybeTargetNode) {
-		auto& targetNode = *maybeTargetNode;
-		if (isDirectory(targetNode) && _directories.countEntries(targetNode) > 0) {
-			return makeError(SystemErrors::NOTEMPTY, "unlink");
+		auto* targetEntry = entryById(targetId);
+		if (targetEntry) {
+			auto const& targetNode = targetEntry->inode;
+			if (isDirectory(targetNode) && _directories->countEntries(targetNode) > 0) {
+				return makeError(SystemErrors::NOTEMPTY, "unlink");
+			}
 		}
+
+		// Entry removed while there are snapshots is retained for them, until Vfs::reclaim finds it is not visible
+		auto maybeUnlinked = _directories->removeEntry(dirNode, name, modification.version,
+													   modification.hasSnapshots());
+		if (!maybeUnlinked) {
+			return maybeUnlinked.moveError();
+		}
+
+		auto const& maybeNodeId = *maybeUnlinked;
+		if (!maybeNodeId)
+			return Ok();
+
+		dirNode.version += 1;  // Note: Releasing a node may destroy it, but never affects the directory
+		commit(*dirEntry, fromDir.index, modification);
+		if (targetEntry) {
+			dropLink(*targetEntry, targetId.index, modification);
+		}
+
+		return Ok();
 	}
+}
 
-	auto maybeUnlinked = _directories.removeEntry(dirNode, name);
-	if (!maybeUnlinked) {
-		return maybeUnlinked.moveError();
+
+Optional<Entry>
+Vfs::lookup(INode::Id dirNodeId, StringView name, Version version) const noexcept {
+	// Note: Directory is pinned before it is read, so that its entries can not be reused while they are searched
+	auto const pinned = EpochReclaimer::pin();
+	auto const dirNode = readNode(dirNodeId, version);
+	if (!dirNode || !isDirectory(*dirNode)) {
+		return none;
 	}
 
-	auto const& maybeNodeId = *maybeUnlinked;
-	if (!maybeNodeId)
-		return Ok();
+	return _directories->lookup(*dirNode, name, version);
+}
+
+
+Optional<INode>
+Vfs::nodeById(INode::Id id) const noexcept {
+	return readNode(id);
+}
 
-	releaseNode(*maybeNodeId);
+
+kasofs::Result<void>
+Vfs::updateNode(INode::Id id, INode inode) {
+	auto modification = beginModification();
+	std::unique_lock<std::shared_mutex> node{nodeLock(id.index)};
+	assignVersion(modification);
+
+	auto* existingNode = entryById(id);
+	if (!existingNode)
+		return makeError(GenericError::BADF, "updateNode");
+
+	if (existingNode->inode.fsTypeId != inode.fsTypeId || existingNode->inode.nodeTypeId != inode.nodeTypeId)
+		return makeError(GenericError::BADF, "updateNode");
+
+	inode.version = existingNode->inode.version + 1;
+	existingNode->inode.swap(inode);
+	commit(*existingNode, id.index, modification);
 	return Ok();
 }
 
 
-Optional<Entry>
-Vfs::lookup(INode::Id dirNodeId, StringView name) const noexcept {
-    auto const maybeNode = nodeById(dirNodeId);
-    if (!maybeNode) {
-        return none;
-    }
+bool
+Vfs::isMissingName(User user, INode::Id dirId, StringView name) const {
+	auto const pinned = EpochReclaimer::pin();
+	auto const dirNode = readNode(dirId);
+	if (!dirNode || !(*dirNode).userCan(user, Permissions::READ)) {
+		return false;
+	}
+
+	return !_directories->lookup(*dirNode, name);
+}
 
-	auto const& dirNode = *maybeNode;
-	if (!isDirectory(dirNode)) {
-        return none;
-    }
 
-	return _directories.lookup(dirNode, name);
+namespace /* anonymous */ {
+
+std::string_view asStringView(StringView s) noexcept {
+	return {s.data(), s.size()};
 }
 
+/// Path given as a span of segments
+struct PathRange {
+	using const_iterator = std::vector<StringView>::const_iterator;
+
+	const_iterator begin() const noexcept { return first; }
+	const_iterator end() const noexcept { return last; }
+
+	const_iterator first;
+	const_iterator last;
+};
+
+/// Reason a path in a batch failed to resolve
+enum class WalkFailure {
+	None,
+	BadRoot,
+	Permission,
+	NotFound,
+	Inconsistent
+};
+
+kasofs::Result<Entry>
+makeWalkResult(WalkFailure failure, Entry const& entry) {
+	switch (failure) {
+	case WalkFailure::None:			return kasofs::Result<Entry>{types::okTag, in_place, entry};
+	case WalkFailure::BadRoot:		return makeError(GenericError::BADF, "walkMany");
+	case WalkFailure::Permission:	return makeError(GenericError::PERM, "walkMany");
+	case WalkFailure::NotFound:		return makeError(GenericError::NOENT, "walkMany");
+	case WalkFailure::Inconsistent:	return makeError(GenericError::NXIO, "walkMany");
+	}
 
-Optional<INode>
-Vfs::nodeById(INode::Id id) const noexcept {
-	if (id.index >= _index.size()) {
-        return none;
-    }
+	return makeError(GenericError::INVAL, "walkMany");
+}
 
-	auto& node = _index[id.index];
-	if (id.gen != node.gen)
+}  // namespace
+
+
+std::vector<kasofs::Result<Entry>>
+Vfs::walkMany(User user, INode::Id rootId,
+			  std::vector<StringView> const& segments,
+			  std::vector<size_type> const& bounds) const {
+	auto const nPaths = bounds.size() - 1;
+	auto const segmentsOf = [&segments, &bounds](size_type i) {
+		return std::make_pair(segments.begin() + bounds[i], segments.begin() + bounds[i + 1]);
+	};
+
+	// Order paths so that paths sharing a prefix are next to each other: equivalent to depth-first walk of a trie.
+	std::vector<size_type> order;
+	order.reserve(nPaths);
+	for (size_type i = 0; i < nPaths; ++i) {
+		auto const path = segmentsOf(i);
+		if (!isRelative(PathRange{path.first, path.second})) {  // Dot segments are resolved by a regular walk
+			order.push_back(i);
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [&segmentsOf](size_type lhs, size_type rhs) {
+		auto const l = segmentsOf(lhs);
+		auto const r = segmentsOf(rhs);
+		return std::lexicographical_compare(l.first, l.second, r.first, r.second,
+											[](StringView a, StringView b) { return asStringView(a) < asStringView(b); });
+	});
+
+	struct Outcome {
+		WalkFailure	failure{WalkFailure::None};
+		Entry		entry{kThisDir, INode::Id{0, 0}};
+	};
+
+	auto const pinned = EpochReclaimer::pin();
+	std::vector<Outcome> outcomes(nPaths);
+	bool const isRootValid = readNode(rootId).isSome();
+
+	// Entries resolved for each segment of the previous path: levels[d] is the entry after d segments
+	std::vector<Entry> levels;
+	levels.emplace_back(kThisDir, rootId);
+	auto failure = isRootValid ? WalkFailure::None : WalkFailure::BadRoot;	//!< Failure of the previous path
+	size_type previous = nPaths;
+
+	for (auto const i : order) {
+		auto const path = segmentsOf(i);
+		auto const pathLength = static_cast<size_type>(path.second - path.first);
+
+		// Number of leading segments shared with the previous path
+		size_type commonLength = 0;
+		if (previous != nPaths) {
+			auto const prevPath = segmentsOf(previous);
+			auto const mismatch = std::mismatch(path.first, path.second, prevPath.first, prevPath.second,
+												[](StringView a, StringView b) { return a.equals(b); });
+			commonLength = static_cast<size_type>(mismatch.first - path.first);
+		}
+		previous = i;
+
+		auto const resolvedDepth = static_cast<size_type>(levels.size() - 1);
+		if (failure != WalkFailure::None && (!isRootValid || commonLength > resolvedDepth)) {
+			// Path shares the prefix that failed to resolve
+			outcomes[i].failure = failure;
+			continue;
+		}
+
+		failure = WalkFailure::None;
+		levels.resize(std::min(commonLength, resolvedDepth) + 1, levels.front());
+		for (auto segment = path.first + (levels.size() - 1); segment != path.second; ++segment) {
+			auto const& current = levels.back();
+			auto const currentNode = readNode(current.nodeId);
+			if (!currentNode || !(*currentNode).userCan(user, Permissions::READ)) {
+				failure = WalkFailure::Permission;
+				break;
+			}
+
+			auto maybeEntry = lookup(current.nodeId, *segment);
+			if (!maybeEntry) {
+				failure = WalkFailure::NotFound;
+				break;
+			}
+
+			if (!readNode((*maybeEntry).nodeId)) {
+				failure = WalkFailure::Inconsistent;
+				break;
+			}
+
+			levels.push_back(*maybeEntry);
+		}
+
+		outcomes[i].failure = failure;
+		if (failure == WalkFailure::None) {
+			outcomes[i].entry = levels[pathLength];
+		}
+	}
+
+	std::vector<kasofs::Result<Entry>> results;
+	results.reserve(nPaths);
+	for (size_type i = 0; i < nPaths; ++i) {
+		auto const path = segmentsOf(i);
+		auto const range = PathRange{path.first, path.second};
+		if (isRelative(range)) {
+			results.emplace_back(resolve(user, rootId, range, [](Entry const&, INode const&) {}));
+		} else {
+			results.emplace_back(makeWalkResult(outcomes[i].failure, outcomes[i].entry));
+		}
+	}
+
+	return results;
+}
+
+
+Optional<kasofs::Result<Entry>>
+Vfs::resolveCached(User user, DentryCache::Record const& record) const {
+	for (auto const& step : record.chain) {
+		auto const node = readNode(step.dirId);
+		if (!node || (*node).version != step.version) {
+			return none;
+		}
+
+		if (!(*node).userCan(user, Permissions::READ)) {
+			return Optional<kasofs::Result<Entry>>{in_place, makeError(GenericError::PERM, "walk")};
+		}
+	}
+
+	if (record.isNegative) {
+		return Optional<kasofs::Result<Entry>>{in_place, makeError(GenericError::NOENT, "walk")};
+	}
+
+	if (!readNode(record.result.nodeId)) {
 		return none;
+	}
 
-	return node.inode;
+	return Optional<kasofs::Result<Entry>>{in_place, types::okTag, record.result};
 }
 
 
-kasofs::Result<void>
-Vfs::updateNode(INode::Id id, INode inode) {
-	if (id.index >= _index.size()) {
-		return makeError(GenericError::BADF, "updateNode");
+void
+Vfs::enableDentryCache(DentryCache::size_type capacity) {
+	auto cache = std::make_unique<DentryCache>(capacity);
+
+	std::unique_lock<std::shared_mutex> registry{_locks->registry};
+	_locks->dentryCache.store(cache.get(), std::memory_order_release);
+	if (_dentryCache) {  // Walks may still be using the replaced cache
+		_retired->retire(static_cast<DentryCache const*>(_dentryCache.release()));
 	}
 
-	auto& existingNode = _index[id.index];
-	if (id.gen != existingNode.gen)
-		return makeError(GenericError::BADF, "updateNode");
+	_dentryCache = mv(cache);
+}
 
-	if (existingNode.inode.fsTypeId != inode.fsTypeId || existingNode.inode.nodeTypeId != inode.nodeTypeId)
-		return makeError(GenericError::BADF, "updateNode");
 
-	existingNode.inode.swap(inode);
+void
+Vfs::disableDentryCache() {
+	std::unique_lock<std::shared_mutex> registry{_locks->registry};
+	_locks->dentryCache.store(nullptr, std::memory_order_release);
+	if (_dentryCache) {  // Walks may still be using the cache
+		_retired->retire(static_cast<DentryCache const*>(_dentryCache.release()));
+	}
+}
+
+
+kasofs::Result<void>
+Vfs::setMetadataPolicy(VfsId fsId, MetadataPolicy policy) {
+	std::unique_lock<std::shared_mutex> registry{_locks->registry};
+	if (fsId >= _drivers.size() || !_drivers[fsId].fs) {
+		return makeError(GenericError::BADF, "setMetadataPolicy");
+	}
+
+	_drivers[fsId].policy = policy;
 	return Ok();
 }
 
 
 kasofs::Result<File>
 Vfs::open(User user, INode::Id fid, Permissions op) {
-	auto maybeNode = nodeById(fid);
-	if (!maybeNode) {
+	std::shared_lock<std::shared_mutex> registry{_locks->registry};
+	auto const node = readNode(fid);
+	if (!node) {
+		return makeError(GenericError::BADF, "open");
+	}
+
+	auto const fsTypeId = (*node).fsTypeId;
+	if (fsTypeId >= _drivers.size()) {
+		return makeError(GenericError::NXIO, "open");
+	}
+
+	return openNode(user, fid, op, _drivers[fsTypeId].policy);
+}
+
+
+kasofs::Result<File>
+Vfs::open(User user, INode::Id fid, Permissions op, MetadataPolicy policy) {
+	std::shared_lock<std::shared_mutex> registry{_locks->registry};
+
+	return openNode(user, fid, op, policy);
+}
+
+
+kasofs::Result<File>
+Vfs::openNode(User user, INode::Id fid, Permissions op, MetadataPolicy policy) {
+	auto modification = beginModification();
+	std::unique_lock<std::shared_mutex> node{nodeLock(fid.index)};
+	assignVersion(modification);
+	auto* nodeEntry = entryById(fid);
+	if (!nodeEntry) {
 		return makeError(GenericError::BADF, "open");
 	}
 
-	auto& vnode = *maybeNode;
+	auto& vnode = nodeEntry->inode;
 	if (!vnode.userCan(user, op)) {
 		return makeError(GenericError::PERM, "open");
 	}
@@ -251,23 +657,34 @@ Vfs::open(User user, INode::Id fid, Permissions op) {
 
 	auto* fs = *maybeFs;
 	auto maybeOpenedFiledId = fs->open(vnode, op);
+	commit(*nodeEntry, fid.index, modification);  // Driver may update the node as it is opened
 	if (!maybeOpenedFiledId) {
 		return maybeOpenedFiledId.moveError();
 	}
 
-	return kasofs::Result<File>{types::okTag, in_place, this, fid, vnode, *maybeOpenedFiledId};
+	nodeEntry->openCount += 1;  // Slot of the node is held until the file is closed, even if node is unlinked
+	{
+		std::lock_guard<std::mutex> slots{_locks->slots};
+		_drivers[vnode.fsTypeId].openCount += 1;
+	}
+
+	return kasofs::Result<File>{types::okTag, in_place, this, fid, vnode, fs, *maybeOpenedFiledId, policy};
 }
 
 
 
 kasofs::Result<EntriesEnumerator>
 Vfs::enumerateDirectory(User user, INode::Id dirNodeId) {
-    auto maybeNode = nodeById(dirNodeId);
-    if (!maybeNode) {
+	auto modification = beginModification();
+	std::unique_lock<std::shared_mutex> node{nodeLock(dirNodeId.index)};
+	assignVersion(modification);
+
+	auto* dirEntry = entryById(dirNodeId);
+	if (!dirEntry) {
 		return makeError(GenericError::BADF, "enumerateDirectory");
-    }
+	}
 
-	auto& dirNode = *maybeNode;
+	auto& dirNode = dirEntry->inode;
 	if (!isDirectory(dirNode)) {
 		return makeError(GenericError::NOTDIR, "enumerateDirectory");
     }
@@ -276,18 +693,14 @@ Vfs::enumerateDirectory(User user, INode::Id dirNodeId) {
 		return makeError(GenericError::PERM, "enumerateDirectory");
     }
 
-	// Enumerate content of a directory node
-	return _directories.enumerateEntries(*this, dirNodeId, dirNode);
-}
-
-
-Optional<Filesystem*>
-Vfs::findFs(VfsId id) const noexcept {
-	auto it = _vfs.find(id);
-	if (it == _vfs.end())
-		return none;
+	// Enumerate content of a directory node. Entries are not modified while the directory is locked.
+	auto result = _directories->enumerateEntries(*this, dirNodeId, dirNode);
+	if (result) {  // Directory is pinned until enumerator is destroyed
+		dirNode.nLinks += 1;
+		commit(*dirEntry, dirNodeId.index, modification);
+	}
 
-	return it->second.get();
+	return result;
 }
 
 
@@ -299,12 +712,12 @@ Vfs::createDirectory(INode::Id where, StringView name, User user, FilePermission
 
 kasofs::Result<INode::Id>
 Vfs::mknode(INode::Id where, StringView name, VfsId type, VfsNodeType nodeType, User owner, FilePermissions perms) {
-	auto const maybeRoot = nodeById(where);
-	if (!maybeRoot) {
+	auto const maybeDir = readNode(where);
+	if (!maybeDir) {
 		return makeError(GenericError::NOENT , "mkNode");
 	}
 
-	auto const& dir = *maybeRoot;
+	auto const& dir = *maybeDir;
 	if (!isDirectory(dir)) {
 		return makeError(GenericError::NOTDIR, "mkNode");
 	}
@@ -314,13 +727,14 @@ Vfs::mknode(INode::Id where, StringView name, VfsId type, VfsNodeType nodeType,
 	}
 
 	auto maybeNewNodeID = createUnlinkedNode(type, nodeType, owner, perms, dir.permissions);
-	if (!maybeNewNodeID) {  // FIXME: new node leakage in case of linking error
+	if (!maybeNewNodeID) {
 		return maybeNewNodeID.moveError();
 	}
 
-	// Link
+	// Link. Note: Directory is not locked in between, so it may have changed or gone since it was checked
 	auto linkResult = link(owner, name, where, *maybeNewNodeID);
-	if (!linkResult) {  // FIXME: failed to link a new node - node must be removed.
+	if (!linkResult) {  // New node has never been linked: it is destroyed by the next Vfs::reclaim
+		releaseNode(*maybeNewNodeID);
 		return linkResult.moveError();
 	}
 
@@ -330,9 +744,10 @@ Vfs::mknode(INode::Id where, StringView name, VfsId type, VfsNodeType nodeType,
 
 kasofs::Result<INode::Id>
 Vfs::createUnlinkedNode(VfsId type, VfsNodeType nodeType, User owner, FilePermissions perms, FilePermissions baseP) {
+	std::shared_lock<std::shared_mutex> registry{_locks->registry};
 	auto maybeVfs = type == DirFs::kTypeId
-			? Optional<Filesystem*>{&_directories}
-			: findFs(type);
+			? Optional<Filesystem*>{_directories.get()}
+			: driverOf(type);
 
 	if (!maybeVfs) {  // Unsupported VFS specified
 		return makeError(SystemErrors::PROTONOSUPPORT, "mknode");
@@ -350,42 +765,403 @@ Vfs::createUnlinkedNode(VfsId type, VfsNodeType nodeType, User owner, FilePermis
 
 	auto& newNode = *maybeNewNode;
 	newNode.fsTypeId = type;
+	auto const boundNode = newNode;
+
+	auto modification = beginModification();
+	std::unique_lock<std::mutex> slots{_locks->slots};
+	_nodeCount += 1;
+	if (_freeListHead == kNoSlot) {  // Note: Slots never move, so appending a slot is safe while nodes are read
+		assignVersion(modification);
+		auto const newNodeIndex = INode::Id(_index->size(), 0);
+		_index->emplace_back(newNodeIndex.gen, maybeNewNode.moveResult(), modification.version);
+		slots.unlock();
+
+		vfs->bindNode(boundNode, newNodeIndex);
+		return Ok(newNodeIndex);
+	}
+
+	// Reuse previously released slot. Slot is off the free list, so nothing else modifies it once slots are unlocked
+	auto const index = _freeListHead;
+	auto& slot = (*_index)[index];
+	_freeListHead = slot.nextFree;
+	slots.unlock();
+
+	std::unique_lock<std::shared_mutex> node{nodeLock(index)};
+	assignVersion(modification);
+	slot.inode = maybeNewNode.moveResult();
+	slot.nextFree = kNoSlot;
+	slot.isLive = true;
+	slot.createdAt = modification.version;
+	slot.unlinkedAt = 0;
+	slot.publish(modification.version);  // Note: States of the released node are never read, so none is retained
+	node.unlock();
+
+	auto const newNodeId = INode::Id(index, slot.gen);
+	vfs->bindNode(boundNode, newNodeId);
+	return Ok(newNodeId);
+}
 
-	auto const newNodeIndex = INode::Id(_index.size(), _genCount++);
-	_index.emplace_back(newNodeIndex.gen, maybeNewNode.moveResult());
 
-	return Ok(newNodeIndex);
+void
+Vfs::publishChangedNodes(Filesystem& fs) {
+	for (auto const& id : fs.takeChangedNodes()) {
+		modifyOpenNode(id, [&fs](INode& node) {
+			node.dataSize = fs.dataSize(node);
+			return true;
+		});
+	}
 }
 
 
 void
 Vfs::addNodeLink(INode::Id id) noexcept {
-	if (id.index >= _index.size()) {
+	auto modification = beginModification();
+	std::unique_lock<std::shared_mutex> node{nodeLock(id.index)};
+	assignVersion(modification);
+
+	auto* entry = entryById(id);
+	if (!entry) {
 		return;
 	}
 
-	auto& node = _index[id.index];
-	if (id.gen != node.gen)
+	entry->inode.nLinks += 1;
+	commit(*entry, id.index, modification);
+}
+
+
+void
+Vfs::releaseNode(INode::Id id) noexcept {
+	auto modification = beginModification();
+	std::unique_lock<std::shared_mutex> node{nodeLock(id.index)};
+	assignVersion(modification);
+
+	auto* entry = entryById(id);
+	if (!entry) {
 		return;
+	}
 
-	node.inode.nLinks += 1;
+	dropLink(*entry, id.index, modification);
 }
 
 
 void
-Vfs::releaseNode(INode::Id id) noexcept {
-	if (id.index >= _index.size()) {
+Vfs::dropLink(INodeEntry& entry, uint32 index, Modification const& modification) noexcept {
+	auto& node = entry.inode;
+	if (node.nLinks > 0)
+		node.nLinks -= 1;
+
+	if (node.nLinks <= 0) {
+		entry.isLive = false;
+		entry.unlinkedAt = modification.version;
+		{
+			std::lock_guard<std::mutex> slots{_locks->slots};
+			_nodeCount -= 1;
+		}
+	}
+	commit(entry, index, modification);
+
+	if (!entry.isLive && entry.openCount == 0) {  // An orphaned node is reclaimed when the last file is closed
+		scheduleReclaim(index);
+	}
+}
+
+
+void
+Vfs::closeFile(INode::Id id, VfsId fsTypeId) noexcept {
+	std::shared_lock<std::shared_mutex> registry{_locks->registry};
+	{
+		std::lock_guard<std::mutex> slots{_locks->slots};
+		if (fsTypeId < _drivers.size() && _drivers[fsTypeId].openCount > 0) {
+			_drivers[fsTypeId].openCount -= 1;
+		}
+	}
+
+	std::unique_lock<std::shared_mutex> node{nodeLock(id.index)};
+	auto* entry = openEntryById(id);
+	if (!entry || entry->openCount == 0) {
 		return;
 	}
 
-	auto& node = _index[id.index];
-	if (id.gen != node.gen)
+	entry->openCount -= 1;
+	if (entry->openCount == 0 && !entry->isLive) {
+		scheduleReclaim(id.index);
+	}
+}
+
+
+void
+Vfs::scheduleReclaim(uint32 index) noexcept {
+	std::lock_guard<std::mutex> slots{_locks->slots};
+
+	// Note: Queue is reserved to hold all slots of the index, so that unlinking a node never allocates
+	if (_reclaimQueue.capacity() < _index->size()) {
+		try {
+			_reclaimQueue.reserve(_index->size());
+		} catch (...) {  // Without a queue the node is never destroyed, but at least its slot can be reused
+			_reclaimStats.failed += 1;
+			releaseSlot(index);
+			return;
+		}
+	}
+
+	_reclaimQueue.push_back(index);
+}
+
+
+Vfs::size_type
+Vfs::reclaim(size_type maxNodes) {
+	std::shared_lock<std::shared_mutex> registry{_locks->registry};
+	std::vector<Version> snapshots;
+	{  // Note: Snapshots taken from now on see no state that has already been replaced
+		std::shared_lock<std::shared_mutex> versions{_locks->versions};
+		snapshots.assign(_snapshots.begin(), _snapshots.end());
+	}
+
+	// Node is seen by snapshots taken after it was created and before it was unlinked
+	auto const isSeenBySnapshot = [&snapshots](INodeEntry const& slot) {
+		auto const it = std::lower_bound(snapshots.begin(), snapshots.end(), slot.createdAt);
+		return (it != snapshots.end() && *it < slot.unlinkedAt);
+	};
+
+	size_type nReclaimed = 0;
+	size_type nReleased = 0;  // Slots released, including slots of nodes a driver failed to destroy
+	std::vector<uint32> busyNodes;
+
+	while (nReleased < maxNodes) {
+		uint32 index;
+		{
+			std::lock_guard<std::mutex> slots{_locks->slots};
+			if (_reclaimQueue.empty())
+				break;
+
+			index = _reclaimQueue.back();
+			_reclaimQueue.pop_back();
+		}
+
+		std::unique_lock<std::shared_mutex> nodeLocked{nodeLock(index)};
+		if (isSeenBySnapshot((*_index)[index])) {
+			busyNodes.push_back(index);
+			continue;
+		}
+
+		auto& node = (*_index)[index].inode;
+		auto maybeFs = node.fsTypeId == DirFs::kTypeId
+				? Optional<Filesystem*>{_directories.get()}
+				: driverOf(node.fsTypeId);
+
+		bool isFailed = false;
+		if (maybeFs) {  // Nodes of an unregistered filesystem have nothing left to destroy
+			auto isDestroyed = (*maybeFs)->destroyNode(node);
+			if (!isDestroyed) {
+				if (isDestroyed.getError().value() == static_cast<int>(GenericError::BUSY)) {  // Node is still in use
+					busyNodes.push_back(index);
+					continue;
+				}
+
+				isFailed = true;
+			}
+		}
+
+		std::lock_guard<std::mutex> slots{_locks->slots};
+		releaseSlot(index);
+		_reclaimStats.failed += isFailed ? 1 : 0;
+		_reclaimStats.reclaimed += isFailed ? 0 : 1;
+		nReclaimed += isFailed ? 0 : 1;
+		nReleased += 1;
+	}
+
+	if (!busyNodes.empty()) {
+		std::lock_guard<std::mutex> slots{_locks->slots};
+		_reclaimQueue.insert(_reclaimQueue.end(), busyNodes.begin(), busyNodes.end());
+	}
+
+	trimHistory(snapshots.empty() ? DirectoryEntries::kLatest : snapshots.front());
+	_retired->collect();
+	_directories->collect();
+
+	return nReclaimed;
+}
+
+
+void
+Vfs::trimHistory(Version oldestVersion) {
+	std::vector<uint32> versionedNodes;
+	{
+		std::lock_guard<std::mutex> slots{_locks->slots};
+		versionedNodes.swap(_versionedNodes);
+		for (auto index : versionedNodes) {
+			(*_index)[index].isVersioned = false;
+		}
+	}
+
+	for (auto index : versionedNodes) {
+		std::unique_lock<std::shared_mutex> node{nodeLock(index)};
+		auto& entry = (*_index)[index];
+
+		// A state replaced in version V is only visible to snapshots taken before V
+		auto const* newer = static_cast<NodeVersion const*>(nullptr);
+		auto const* record = entry.history.load(std::memory_order_relaxed);
+		while (record && oldestVersion < record->until) {
+			newer = record;
+			record = record->older.load(std::memory_order_relaxed);
+		}
+
+		if (record) {
+			auto& link = newer ? newer->older : entry.history;
+			link.store(nullptr, std::memory_order_release);
+			retireHistory(record);
+		}
+
+		bool isRetained = (entry.history.load(std::memory_order_relaxed) != nullptr);
+		if (entry.isLive && isDirectory(entry.inode)) {  // Removed entries of a dead directory go once it is destroyed
+			isRetained = _directories->purge(entry.inode, oldestVersion) || isRetained;
+		}
+
+		if (isRetained) {
+			std::lock_guard<std::mutex> slots{_locks->slots};
+			if (!entry.isVersioned) {
+				_versionedNodes.push_back(index);
+				entry.isVersioned = true;
+			}
+		}
+	}
+}
+
+
+void
+Vfs::releaseSlot(uint32 index) noexcept {
+	auto& slot = (*_index)[index];
+	slot.gen += 1;
+	slot.nextFree = _freeListHead;
+	_freeListHead = index;
+	slot.publish(_locks->version.load(std::memory_order_acquire));
+	retireHistory(slot.history.exchange(nullptr, std::memory_order_acq_rel));
+}
+
+
+void
+Vfs::retireHistory(NodeVersion const* record) noexcept {
+	while (record) {
+		auto const* older = record->older.load(std::memory_order_relaxed);
+		_retired->retire(record);
+		record = older;
+	}
+}
+
+
+void
+Vfs::commit(INodeEntry& entry, uint32 index, Modification const& modification) noexcept {
+	auto const replaced = entry.read();
+	if (replaced.since <= modification.newestSnapshot) {  // Replaced state is visible to a snapshot: retain it
+		// Note: Without memory to retain the state, snapshots see the new one
+		auto const* record = new (std::nothrow) NodeVersion{replaced, modification.version,
+															  entry.history.load(std::memory_order_relaxed)};
+		if (record) {
+			entry.history.store(record, std::memory_order_release);
+
+			std::lock_guard<std::mutex> slots{_locks->slots};
+			if (!entry.isVersioned) {
+				try {
+					_versionedNodes.push_back(index);
+					entry.isVersioned = true;
+				} catch (...) {  // States are retained until the slot is released
+				}
+			}
+		}
+	}
+
+	entry.publish(modification.version);
+}
+
+
+Vfs::Modification
+Vfs::beginModification() const {
+	std::shared_lock<std::shared_mutex> versions{_locks->versions};
+	auto const newestSnapshot = _snapshots.empty() ? Version{0} : *_snapshots.rbegin();
+
+	return Modification{mv(versions), newestSnapshot};
+}
+
+
+Vfs::Snapshot
+Vfs::snapshot() {
+	std::unique_lock<std::shared_mutex> versions{_locks->versions};
+	auto const version = _locks->version.load(std::memory_order_acquire);
+	_snapshots.insert(version);
+
+	return Snapshot{this, version};
+}
+
+
+void
+Vfs::releaseSnapshot(Version version) noexcept {
+	std::unique_lock<std::shared_mutex> versions{_locks->versions};
+	auto it = _snapshots.find(version);
+	if (it != _snapshots.end()) {
+		_snapshots.erase(it);
+	}
+}
+
+
+Vfs::Snapshot::~Snapshot() {
+	release();
+}
+
+
+Vfs::Snapshot::Snapshot(Snapshot&& rhs) noexcept
+	: _vfs{std::exchange(rhs._vfs, nullptr)}
+	, _version{rhs._version}
+{
+}
+
+
+Vfs::Snapshot&
+Vfs::Snapshot::operator= (Snapshot&& rhs) noexcept {
+	if (this != &rhs) {
+		release();
+
+		_vfs = std::exchange(rhs._vfs, nullptr);
+		_version = rhs._version;
+	}
+
+	return *this;
+}
+
+
+void
+Vfs::Snapshot::release() noexcept {
+	if (!_vfs)
 		return;
 
-	if (node.inode.nLinks > 0)
-		node.inode.nLinks -= 1;
+	_vfs->releaseSnapshot(_version);
+	_vfs = nullptr;
+}
+
+
+Optional<INode>
+Vfs::Snapshot::nodeById(INode::Id id) const noexcept {
+	auto const pinned = EpochReclaimer::pin();
 
-	if (node.inode.nLinks <= 0) {
-		_index.erase(_index.begin() + id.index);
+	return _vfs->readNode(id, _version);
+}
+
+
+kasofs::Result<EntriesEnumerator>
+Vfs::Snapshot::enumerateDirectory(User user, INode::Id dirId) const {
+	auto const pinned = EpochReclaimer::pin();
+	auto const dirNode = _vfs->readNode(dirId, _version);
+	if (!dirNode) {
+		return makeError(GenericError::BADF, "Snapshot::enumerateDirectory");
 	}
+
+	if (!isDirectory(*dirNode)) {
+		return makeError(GenericError::NOTDIR, "Snapshot::enumerateDirectory");
+	}
+
+	if (!(*dirNode).userCan(user, Permissions::READ)) {
+		return makeError(GenericError::PERM, "Snapshot::enumerateDirectory");
+	}
+
+	// Entries are copied out, so the enumerator does not keep the directory pinned
+	return _vfs->_directories->enumerateEntries(*dirNode, _version);
 }
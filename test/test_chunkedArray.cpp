@@ -0,0 +1,83 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_chunkedArray.cpp
+ *	@brief		Test suit for KasoFS::ChunkedArray
+ ******************************************************************************/
+#include "kasofs/chunkedArray.hpp"    // Class being tested.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+TEST(TestChunkedArray, elementsDoNotMoveAsArrayGrows) {
+	ChunkedArray<uint32> array;
+	EXPECT_TRUE(array.empty());
+
+	auto& first = array.emplace_back(0U);
+	std::vector<uint32*> addresses{&first};
+	for (uint32 i = 1; i < 10000; ++i) {
+		addresses.push_back(&array.emplace_back(i));
+	}
+
+	EXPECT_EQ(10000U, array.size());
+	for (uint32 i = 0; i < array.size(); ++i) {
+		EXPECT_EQ(addresses[i], &array[i]);
+		EXPECT_EQ(i, array[i]);
+	}
+}
+
+
+TEST(TestChunkedArray, elementsAreDestroyedWithArray) {
+	auto counter = std::make_shared<int>(0);
+	{
+		ChunkedArray<std::shared_ptr<int>> array;
+		for (int i = 0; i < 100; ++i) {
+			array.emplace_back(counter);
+		}
+		EXPECT_EQ(101, counter.use_count());
+	}
+
+	EXPECT_EQ(1, counter.use_count());
+}
+
+
+TEST(TestChunkedArray, readersSeePublishedElements) {
+	ChunkedArray<std::atomic<uint32>> array;
+	uint32 const count = 50000;
+	std::atomic<int> nMismatches{0};
+
+	std::thread reader{[&array, &nMismatches, count]() noexcept {
+		uint32 nSeen = 0;
+		while (nSeen < count) {
+			nSeen = array.size();
+			for (uint32 i = (nSeen > 64 ? nSeen - 64 : 0); i < nSeen; ++i) {
+				if (array[i].load(std::memory_order_relaxed) != i) {
+					nMismatches += 1;
+				}
+			}
+		}
+	}};
+
+	for (uint32 i = 0; i < count; ++i) {
+		array.emplace_back(i);
+	}
+	reader.join();
+
+	EXPECT_EQ(0, nMismatches.load());
+}
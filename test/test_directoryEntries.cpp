@@ -0,0 +1,180 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_directoryEntries.cpp
+ *	@brief		Test suit for KasoFS::DirectoryEntries
+ ******************************************************************************/
+#include "kasofs/directoryEntries.hpp"    // Class being tested.
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+namespace {
+
+/// Names of entries, kept alive for the duration of a test as entries view them
+struct Names {
+	explicit Names(DirectoryEntries::NameHandle count) {
+		for (DirectoryEntries::NameHandle i = 0; i < count; ++i) {
+			storage.push_back("entry-" + std::to_string(i));
+		}
+	}
+
+	EntryName operator[] (DirectoryEntries::NameHandle i) const noexcept {
+		return EntryName{StringView{storage[i].data(), static_cast<StringView::size_type>(storage[i].size())}};
+	}
+
+	std::vector<std::string> storage;
+};
+
+
+std::set<DirectoryEntries::NameHandle>
+enumerate(DirectoryEntries const& entries) {
+	std::set<DirectoryEntries::NameHandle> names;
+	entries.forEach([&names](DirectoryEntries::Slot const& slot) {
+		EXPECT_EQ(slot.handle + 100, slot.nodeId.index);
+		names.insert(slot.handle);
+	});
+
+	return names;
+}
+
+}  // namespace
+
+
+TEST(TestDirectoryEntries, findInsertedEntries) {
+	EpochReclaimer reclaimer;
+	DirectoryEntries entries;
+	Names const names{16};
+	EXPECT_TRUE(entries.empty());
+	EXPECT_EQ(nullptr, entries.find(names[0]));
+
+	for (DirectoryEntries::NameHandle i = 0; i < 4; ++i) {
+		EXPECT_TRUE(entries.insert(names[i], i, INode::Id{i + 100, 0}, 1, reclaimer));
+	}
+
+	EXPECT_EQ(4U, entries.size());
+	EXPECT_EQ(DirectoryEntries::kMinCapacity, entries.capacity());
+	EXPECT_FALSE(entries.insert(names[3], 3, INode::Id{0, 0}, 1, reclaimer));
+
+	auto const* slot = entries.find(names[3]);
+	ASSERT_NE(nullptr, slot);
+	EXPECT_EQ(103U, slot->nodeId.index);
+	EXPECT_TRUE(slot->name.name.equals(StringView{"entry-3"}));
+	EXPECT_EQ(nullptr, entries.find(names[4]));
+}
+
+
+TEST(TestDirectoryEntries, tableGrowsAndShrinks) {
+	EpochReclaimer reclaimer;
+	DirectoryEntries entries;
+	DirectoryEntries::NameHandle const count = 100;
+	Names const names{count};
+
+	for (DirectoryEntries::NameHandle i = 0; i < count; ++i) {
+		EXPECT_TRUE(entries.insert(names[i], i, INode::Id{i + 100, 0}, 1, reclaimer));
+	}
+	EXPECT_LE(2 * count, entries.capacity());
+	EXPECT_EQ(count, entries.size());
+	EXPECT_EQ(count, enumerate(entries).size());
+	EXPECT_FALSE(entries.insert(names[42], 42, INode::Id{0, 0}, 1, reclaimer));
+
+	for (DirectoryEntries::NameHandle i = 0; i < count; i += 2) {
+		auto maybeRemoved = entries.erase(names[i], 2, false, reclaimer);
+		ASSERT_TRUE(maybeRemoved.isSome());
+		EXPECT_EQ(i + 100, (*maybeRemoved).nodeId.index);
+		EXPECT_EQ(i, (*maybeRemoved).handle);
+	}
+	EXPECT_EQ(count / 2, entries.size());
+	EXPECT_TRUE(entries.erase(names[0], 2, false, reclaimer).isNone());
+
+	for (DirectoryEntries::NameHandle i = 0; i < count; ++i) {
+		EXPECT_EQ(i % 2 == 1, entries.find(names[i]) != nullptr);
+	}
+
+	// Shrink the directory back
+	for (DirectoryEntries::NameHandle i = 1; i < count - 6; i += 2) {
+		EXPECT_TRUE(entries.erase(names[i], 2, false, reclaimer).isSome());
+	}
+	EXPECT_GT(count, entries.capacity());
+	EXPECT_EQ((std::set<DirectoryEntries::NameHandle>{95, 97, 99}), enumerate(entries));
+	EXPECT_NE(nullptr, entries.find(names[97]));
+
+	// Removed entries and replaced tables are destroyed once collected
+	EXPECT_LT(0U, reclaimer.pending());
+	reclaimer.collect();
+	EXPECT_EQ(0U, reclaimer.pending());
+}
+
+
+TEST(TestDirectoryEntries, removedNamesCanBeReused) {
+	EpochReclaimer reclaimer;
+	DirectoryEntries entries;
+	Names const names{64};
+
+	// Churn through a small table: tombstones must not exhaust it
+	for (int round = 0; round < 10; ++round) {
+		for (DirectoryEntries::NameHandle i = 0; i < 64; ++i) {
+			EXPECT_TRUE(entries.insert(names[i], i, INode::Id{i + 100, 0}, 1, reclaimer));
+			EXPECT_TRUE(entries.erase(names[i], 2, false, reclaimer).isSome());
+		}
+	}
+
+	EXPECT_TRUE(entries.empty());
+	EXPECT_TRUE(entries.insert(names[7], 7, INode::Id{107, 0}, 1, reclaimer));
+	EXPECT_NE(nullptr, entries.find(names[7]));
+
+	entries.clear(reclaimer);
+	EXPECT_TRUE(entries.empty());
+	EXPECT_EQ(nullptr, entries.find(names[7]));
+}
+
+
+TEST(TestDirectoryEntries, retainedEntriesAreVisibleToEarlierVersions) {
+	EpochReclaimer reclaimer;
+	DirectoryEntries entries;
+	Names const names{3};
+
+	EXPECT_TRUE(entries.insert(names[0], 0, INode::Id{100, 0}, 1, reclaimer));
+	EXPECT_TRUE(entries.insert(names[1], 1, INode::Id{101, 0}, 2, reclaimer));
+	EXPECT_TRUE(entries.erase(names[0], 3, true, reclaimer).isSome());
+	EXPECT_TRUE(entries.erase(names[1], 4, false, reclaimer).isSome());
+	EXPECT_EQ(0U, entries.size());
+	EXPECT_EQ(1U, entries.retained());
+
+	// Removed name can be linked again, while the earlier entry is still retained
+	EXPECT_TRUE(entries.insert(names[0], 2, INode::Id{102, 0}, 5, reclaimer));
+	EXPECT_EQ(nullptr, entries.find(names[0], 0));
+	EXPECT_EQ(100U, entries.find(names[0], 2)->nodeId.index);
+	EXPECT_EQ(nullptr, entries.find(names[0], 4));
+	EXPECT_EQ(102U, entries.find(names[0])->nodeId.index);
+	EXPECT_EQ(nullptr, entries.find(names[1], 2));  // Not retained
+
+	std::set<DirectoryEntries::NameHandle> seen;
+	entries.forEachAt(2, [&seen](DirectoryEntries::Slot const& slot) { seen.insert(slot.handle); });
+	EXPECT_EQ((std::set<DirectoryEntries::NameHandle>{0}), seen);
+
+	// Entry removed in version 3 is still visible to version 2
+	EXPECT_TRUE(entries.purge(2, reclaimer).empty());
+	EXPECT_EQ(1U, entries.retained());
+
+	auto const purged = entries.purge(3, reclaimer);
+	EXPECT_EQ((std::vector<DirectoryEntries::NameHandle>{0}), purged);
+	EXPECT_EQ(0U, entries.retained());
+	EXPECT_EQ(nullptr, entries.find(names[0], 2));
+	EXPECT_EQ(102U, entries.find(names[0])->nodeId.index);
+}
@@ -0,0 +1,150 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_epochReclaimer.cpp
+ *	@brief		Test suit for KasoFS::EpochReclaimer
+ ******************************************************************************/
+#include "kasofs/epochReclaimer.hpp"    // Class being tested.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+TEST(TestEpochReclaimer, retiredObjectIsDestroyedWithoutReaders) {
+	EpochReclaimer reclaimer;
+	int nDestroyed = 0;
+
+	reclaimer.retire([&nDestroyed]() noexcept { nDestroyed += 1; });
+	EXPECT_EQ(1U, reclaimer.pending());
+	EXPECT_EQ(0, nDestroyed);
+
+	EXPECT_EQ(1U, reclaimer.collect());
+	EXPECT_EQ(1, nDestroyed);
+	EXPECT_EQ(0U, reclaimer.pending());
+}
+
+
+TEST(TestEpochReclaimer, pinnedReaderDelaysDestruction) {
+	EpochReclaimer reclaimer;
+	int nDestroyed = 0;
+
+	{
+		auto const pinned = EpochReclaimer::pin();
+		{
+			auto const nested = EpochReclaimer::pin();
+			reclaimer.retire([&nDestroyed]() noexcept { nDestroyed += 1; });
+		}
+
+		// Reader is still pinned by the outer guard
+		EXPECT_EQ(0U, reclaimer.collect());
+		EXPECT_EQ(0, nDestroyed);
+	}
+
+	EXPECT_EQ(1U, reclaimer.collect());
+	EXPECT_EQ(1, nDestroyed);
+}
+
+
+TEST(TestEpochReclaimer, readerOfAnotherThreadDelaysDestruction) {
+	EpochReclaimer reclaimer;
+	std::atomic<int> nDestroyed{0};
+	std::atomic<bool> isPinned{false};
+	std::atomic<bool> isReleased{false};
+
+	std::thread reader{[&isPinned, &isReleased]() noexcept {
+		auto const pinned = EpochReclaimer::pin();
+		isPinned.store(true);
+		while (!isReleased.load()) {
+			std::this_thread::yield();
+		}
+	}};
+
+	while (!isPinned.load()) {
+		std::this_thread::yield();
+	}
+
+	reclaimer.retire([&nDestroyed]() noexcept { nDestroyed += 1; });
+	EXPECT_EQ(0U, reclaimer.collect());
+	EXPECT_EQ(0, nDestroyed.load());
+
+	isReleased.store(true);
+	reader.join();
+
+	EXPECT_EQ(1U, reclaimer.collect());
+	EXPECT_EQ(1, nDestroyed.load());
+}
+
+
+TEST(TestEpochReclaimer, pendingObjectsAreDestroyedWithReclaimer) {
+	int nDestroyed = 0;
+	{
+		EpochReclaimer reclaimer;
+		auto const pinned = EpochReclaimer::pin();
+		reclaimer.retire([&nDestroyed]() noexcept { nDestroyed += 1; });
+		reclaimer.retire(new int{42});
+		EXPECT_EQ(2U, reclaimer.pending());
+	}
+
+	EXPECT_EQ(1, nDestroyed);
+}
+
+
+namespace {
+
+struct Counted : public EpochReclaimer::Retirable {
+	explicit Counted(std::atomic<int>& counter) noexcept
+		: nDestroyed{counter}
+	{}
+
+	~Counted() {
+		nDestroyed += 1;
+	}
+
+	std::atomic<int>&	nDestroyed;
+};
+
+}  // namespace
+
+
+TEST(TestEpochReclaimer, objectsRetiredByThreadsAreDestroyedOnce) {
+	std::atomic<int> nDestroyed{0};
+	constexpr int kThreads = 4;
+	constexpr int kObjectsPerThread = 1000;
+	{
+		EpochReclaimer reclaimer;
+
+		std::vector<std::thread> writers;
+		for (int i = 0; i < kThreads; ++i) {
+			writers.emplace_back([&reclaimer, &nDestroyed]() noexcept {
+				for (int j = 0; j < kObjectsPerThread; ++j) {
+					auto const pinned = EpochReclaimer::pin();
+					reclaimer.retire(new Counted{nDestroyed});
+				}
+			});
+		}
+
+		for (auto& writer : writers) {
+			writer.join();
+		}
+
+		EXPECT_EQ(kThreads * kObjectsPerThread, nDestroyed.load() + static_cast<int>(reclaimer.pending()));
+		reclaimer.collect();
+		EXPECT_EQ(0U, reclaimer.pending());
+	}
+
+	EXPECT_EQ(kThreads * kObjectsPerThread, nDestroyed.load());
+}
@@ -0,0 +1,92 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_lzCodec.cpp
+ *	@brief		Test suit for KasoFS::LzCodec
+ ******************************************************************************/
+#include "kasofs/extras/lzCodec.hpp"    // Class being tested.
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+namespace {
+
+std::vector<byte> roundTrip(MemoryView src, LzCodec::size_type* compressedSize = nullptr) {
+	std::vector<byte> compressed(LzCodec::compressBound(src.size()));
+	auto const size = LzCodec::compress(src, wrapMemory(compressed.data(), compressed.size()));
+	EXPECT_LT(0U, size);
+	if (compressedSize) {
+		*compressedSize = size;
+	}
+
+	std::vector<byte> result(src.size());
+	auto maybeSize = LzCodec::decompress(wrapMemory(compressed.data(), size), wrapMemory(result.data(), result.size()));
+	EXPECT_TRUE(maybeSize.isOk());
+	EXPECT_EQ(src.size(), *maybeSize);
+
+	return result;
+}
+
+}  // namespace
+
+
+TEST(TestLzCodec, emptyDataRoundTrips) {
+	auto result = roundTrip(MemoryView{});
+	EXPECT_TRUE(result.empty());
+}
+
+
+TEST(TestLzCodec, repetitiveDataIsCompressed) {
+	std::string text;
+	while (text.size() < 16 * 1024) {
+		text += "2020-01-01T00:00:00 INFO [kasofs] request served in 12ms\n";
+	}
+
+	LzCodec::size_type compressedSize = 0;
+	auto result = roundTrip(wrapMemory(text.data(), text.size()), &compressedSize);
+	EXPECT_EQ(0, memcmp(text.data(), result.data(), text.size()));
+	EXPECT_LT(compressedSize * 5, text.size());
+}
+
+
+TEST(TestLzCodec, randomDataRoundTrips) {
+	std::vector<byte> data(10000);
+	uint32 state = 12345;
+	for (auto& value : data) {
+		state = state * 1103515245 + 12345;
+		value = static_cast<byte>(state >> 16);
+	}
+
+	auto result = roundTrip(wrapMemory(data.data(), data.size()));
+	EXPECT_EQ(data, result);
+
+	// Incompressible data does not fit into a buffer smaller than the source
+	std::vector<byte> compressed(data.size() / 2);
+	EXPECT_EQ(0U, LzCodec::compress(wrapMemory(data.data(), data.size()),
+									wrapMemory(compressed.data(), compressed.size())));
+}
+
+
+TEST(TestLzCodec, malformedDataIsNotOk) {
+	byte const badOffset[] = {0x10, 'a', 0x10, 0x00};  // Back reference beyond the start of the output
+	byte dest[64];
+	EXPECT_TRUE(LzCodec::decompress(wrapMemory(badOffset), wrapMemory(dest)).isError());
+
+	byte const truncated[] = {0xF0, 0xFF};  // Literals length that is never terminated
+	EXPECT_TRUE(LzCodec::decompress(wrapMemory(truncated), wrapMemory(dest)).isError());
+}
@@ -0,0 +1,102 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_namePool.cpp
+ *	@brief		Test suit for KasoFS::NamePool
+ ******************************************************************************/
+#include "kasofs/namePool.hpp"    // Class being tested.
+
+#include <gtest/gtest.h>
+#include <solace/output_utils.hpp>
+
+#include <string>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+TEST(TestNamePool, identicalNamesAreInternedOnce) {
+	NamePool pool;
+
+	char name1[] = "config";
+	char name2[] = "config";
+	auto h1 = pool.intern(StringView{name1});
+	auto h2 = pool.intern(StringView{name2});
+
+	EXPECT_EQ(h1, h2);
+	EXPECT_EQ(1U, pool.size());
+	EXPECT_EQ(StringView{"config"}, pool.name(h1));
+
+	// Pool owns a copy of the name
+	EXPECT_NE(static_cast<char const*>(name1), pool.name(h1).data());
+}
+
+
+TEST(TestNamePool, findDoesNotIntern) {
+	NamePool pool;
+
+	EXPECT_TRUE(pool.find("name").isNone());
+	EXPECT_EQ(0U, pool.size());
+
+	auto h = pool.intern("name");
+	auto maybeHandle = pool.find("name");
+	ASSERT_TRUE(maybeHandle.isSome());
+	EXPECT_EQ(h, *maybeHandle);
+	EXPECT_TRUE(pool.find("other").isNone());
+}
+
+
+TEST(TestNamePool, nameIsReleasedWithLastReference) {
+	NamePool pool;
+
+	auto h = pool.intern("name");
+	pool.intern("name");
+
+	pool.release(h);
+	EXPECT_TRUE(pool.find("name").isSome());
+
+	pool.release(h);
+	EXPECT_TRUE(pool.find("name").isNone());
+	EXPECT_EQ(0U, pool.size());
+}
+
+
+TEST(TestNamePool, releasedStorageIsReused) {
+	NamePool pool;
+
+	for (int i = 0; i < 10000; ++i) {
+		auto name = std::to_string(100000 + i);
+		auto h = pool.intern(StringView{name.data(), static_cast<StringView::size_type>(name.size())});
+		EXPECT_EQ(StringView(name.data(), static_cast<StringView::size_type>(name.size())), pool.name(h));
+		pool.release(h);
+	}
+
+	EXPECT_EQ(0U, pool.size());
+	EXPECT_EQ(NamePool::kBlockSize, pool.capacity());
+}
+
+
+TEST(TestNamePool, viewsRemainValidAsPoolGrows) {
+	NamePool pool;
+
+	auto h = pool.intern("first-name");
+	auto const view = pool.name(h);
+
+	std::string longName(NamePool::kBlockSize + 1, 'x');
+	pool.intern(StringView{longName.data(), static_cast<StringView::size_type>(longName.size())});
+	for (int i = 0; i < 5000; ++i) {
+		auto name = std::to_string(i);
+		pool.intern(StringView{name.data(), static_cast<StringView::size_type>(name.size())});
+	}
+
+	EXPECT_EQ(view.data(), pool.name(h).data());
+	EXPECT_EQ(StringView{"first-name"}, view);
+}
@@ -0,0 +1,131 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_pagePool.cpp
+ *	@brief		Test suit for KasoFS::PagePool
+ ******************************************************************************/
+#include "kasofs/extras/pagePool.hpp"    // Class being tested.
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>  // pread
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+TEST(TestPagePool, capacityIsRoundedDownToPages) {
+	PagePool pool{3 * PagePool::kPageSize + 100};
+
+	EXPECT_EQ(3U, pool.maxPages());
+	EXPECT_EQ(3 * PagePool::kPageSize, pool.capacity());
+	EXPECT_EQ(0U, pool.pagesInUse());
+	EXPECT_EQ(3U, pool.pagesAvailable());
+}
+
+
+TEST(TestPagePool, allocatingBeyondCapacityIsNotOk) {
+	PagePool pool{2 * PagePool::kPageSize};
+
+	auto page0 = pool.allocate();
+	auto page1 = pool.allocate();
+	ASSERT_TRUE(page0.isOk());
+	ASSERT_TRUE(page1.isOk());
+	EXPECT_NE(*page0, *page1);
+	EXPECT_EQ(2 * PagePool::kPageSize, pool.bytesInUse());
+
+	EXPECT_TRUE(pool.allocate().isError());
+}
+
+
+TEST(TestPagePool, releasedPageIsReused) {
+	PagePool pool{PagePool::kPagesPerChunk * PagePool::kPageSize * 2};
+
+	auto maybePage = pool.allocate();
+	ASSERT_TRUE(maybePage.isOk());
+	auto const page = *maybePage;
+	auto const address = pool.page(page).dataAddress();
+
+	pool.release(page);
+	EXPECT_EQ(0U, pool.pagesInUse());
+
+	auto maybeReused = pool.allocate();
+	ASSERT_TRUE(maybeReused.isOk());
+	EXPECT_EQ(page, *maybeReused);
+	EXPECT_EQ(address, pool.page(*maybeReused).dataAddress());
+}
+
+
+TEST(TestPagePool, pagesDoNotMoveAsPoolGrows) {
+	PagePool pool{PagePool::kPagesPerChunk * PagePool::kPageSize * 2};
+
+	auto first = pool.allocate();
+	ASSERT_TRUE(first.isOk());
+	auto firstPage = pool.page(*first);
+	firstPage.fill(0xAB);
+
+	for (PagePool::size_type i = 1; i < PagePool::kPagesPerChunk + 1; ++i) {
+		auto maybePage = pool.allocate();
+		ASSERT_TRUE(maybePage.isOk());
+		EXPECT_EQ(PagePool::kPageSize, pool.page(*maybePage).size());
+	}
+
+	EXPECT_EQ(firstPage.dataAddress(), pool.page(*first).dataAddress());
+	EXPECT_EQ(0xAB, firstPage.dataAddress()[PagePool::kPageSize - 1]);
+}
+
+
+TEST(TestPagePool, sharedPageIsReleasedWithLastReference) {
+	PagePool pool{2 * PagePool::kPageSize};
+
+	auto maybePage = pool.allocate();
+	ASSERT_TRUE(maybePage.isOk());
+	EXPECT_EQ(1U, pool.refCount(*maybePage));
+
+	pool.share(*maybePage);
+	EXPECT_EQ(2U, pool.refCount(*maybePage));
+
+	EXPECT_FALSE(pool.release(*maybePage));
+	EXPECT_EQ(1U, pool.pagesInUse());
+
+	EXPECT_TRUE(pool.release(*maybePage));
+	EXPECT_EQ(0U, pool.pagesInUse());
+}
+
+
+TEST(TestPagePool, sharedMemoryPagesAreMappedFromPoolFile) {
+	PagePool pool{4 * PagePool::kPageSize, PagePool::Backing::SharedMemory};
+	if (pool.backing() == PagePool::Backing::Heap) {
+		EXPECT_EQ(-1, pool.fd());
+		return;  // Shared memory is not supported by the system
+	}
+
+	EXPECT_LE(0, pool.fd());
+	auto maybePage = pool.allocate();
+	ASSERT_TRUE(maybePage.isOk());
+
+	auto page = pool.page(*maybePage);
+	page.fill(0x5A);
+
+	byte value = 0;
+	ASSERT_EQ(1, pread(pool.fd(), &value, 1, static_cast<off_t>(pool.fileOffset(*maybePage) + 10)));
+	EXPECT_EQ(0x5A, value);
+}
+
+
+TEST(TestPagePool, hugePagesFallBackIfNotAvailable) {
+	PagePool pool{4 * PagePool::kPageSize, PagePool::Backing::HugePages};
+
+	auto maybePage = pool.allocate();
+	ASSERT_TRUE(maybePage.isOk());
+	pool.page(*maybePage).fill(1);
+	EXPECT_EQ(1, pool.page(*maybePage).dataAddress()[PagePool::kPageSize - 1]);
+}
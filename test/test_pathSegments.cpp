@@ -0,0 +1,71 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_pathSegments.cpp
+ *	@brief		Test suit for KasoFS::PathSegments and KasoFS::StaticPath
+ ******************************************************************************/
+#include "kasofs/pathSegments.hpp"    // Class being tested.
+
+#include <gtest/gtest.h>
+#include <solace/output_utils.hpp>
+
+#include <string>
+#include <vector>
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+namespace  {
+
+template<typename P>
+std::vector<std::string> segmentsOf(P const& path) {
+	std::vector<std::string> result;
+	for (auto segment : path) {
+		result.emplace_back(segment.data(), segment.size());
+	}
+
+	return result;
+}
+
+}  // namespace
+
+
+TEST(TestPathSegments, splitsPathInPlace) {
+	char const path[] = "etc/app/config";
+	PathSegments segments{StringView{path}};
+
+	EXPECT_FALSE(segments.empty());
+	EXPECT_EQ((std::vector<std::string>{"etc", "app", "config"}), segmentsOf(segments));
+
+	// Segments are views into the original string
+	EXPECT_EQ(static_cast<char const*>(path) + 4, (*(++segments.begin())).data());
+}
+
+
+TEST(TestPathSegments, emptySegmentsAreSkipped) {
+	EXPECT_EQ((std::vector<std::string>{"a", "b"}), segmentsOf(PathSegments{StringView{"//a///b/"}}));
+	EXPECT_EQ((std::vector<std::string>{"..", ".", "c"}), segmentsOf(PathSegments{StringView{".././/c"}}));
+
+	EXPECT_TRUE(PathSegments{StringView{""}}.empty());
+	EXPECT_TRUE(PathSegments{StringView{"///"}}.empty());
+}
+
+
+TEST(TestStaticPath, splitsPathAtCompileTime) {
+	constexpr StaticPath path{"/etc//app/config"};
+	static_assert(path.size() == 3, "Path literal must be split at compile time");
+
+	EXPECT_EQ((std::vector<std::string>{"etc", "app", "config"}), segmentsOf(path));
+
+	constexpr StaticPath root{"/"};
+	static_assert(root.empty(), "Root path has no segments");
+}
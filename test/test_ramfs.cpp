@@ -0,0 +1,769 @@
+/*
+*  Copyright (C) Ivan Ryabov - All Rights Reserved
+*
+*  Unauthorized copying of this file, via any medium is strictly prohibited.
+*  Proprietary and confidential.
+*
+*  Written by Ivan Ryabov <abbyssoul@gmail.com>
+*/
+/*******************************************************************************
+ * KasoFS Unit Test Suit
+ *	@file test/test_ramfs.cpp
+ *	@brief		Test suit for KasoFS::RamFS
+ ******************************************************************************/
+#include "kasofs/extras/ramfsDriver.hpp"    // Class being tested.
+#include "kasofs/vfs.hpp"
+
+#include <gtest/gtest.h>
+#include <solace/output_utils.hpp>
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>  // pread
+
+
+using namespace kasofs;
+using namespace Solace;
+
+
+struct RamFSTest : public ::testing::Test {
+	static constexpr uint64 kCapacity = 16 * PagePool::kPageSize;
+
+	void SetUp() override {
+		auto maybeFsId = vfs.registerFilesystem<RamFS>(kCapacity);
+		ASSERT_TRUE(maybeFsId.isOk());
+		fsId = *maybeFsId;
+
+		auto maybeNodeId = vfs.mknode(vfs.rootId(), "data", fsId, RamFS::kNodeType, owner);
+		ASSERT_TRUE(maybeNodeId.isOk());
+		nodeId = *maybeNodeId;
+	}
+
+protected:
+	User		owner{0, 0};
+	Vfs			vfs{owner, FilePermissions{0777}};
+	VfsId		fsId{0};
+	INode::Id	nodeId{0, 0};
+};
+
+
+TEST_F(RamFSTest, writtenDataCanBeReadBack) {
+	char msg[] = "Hello, RAM";
+	{
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		auto maybeWritten = (*maybeFile).write(wrapMemory(msg));
+		ASSERT_TRUE(maybeWritten.isOk());
+		EXPECT_EQ(sizeof(msg), *maybeWritten);
+	}
+
+	EXPECT_EQ(sizeof(msg), (*vfs.nodeById(nodeId)).dataSize);
+
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::READ);
+	ASSERT_TRUE(maybeFile.isOk());
+
+	char buffer[32];
+	auto maybeRead = (*maybeFile).read(wrapMemory(buffer));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(sizeof(msg), *maybeRead);
+	EXPECT_STREQ(msg, buffer);
+}
+
+
+TEST_F(RamFSTest, vectoredWriteAndRead) {
+	char header[] = {'H', 'D', 'R', ':'};
+	char payload[] = "payload";
+	MemoryView const src[] = {wrapMemory(header), wrapMemory(payload)};
+	{
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		auto maybeWritten = (*maybeFile).writev(arrayView(src));
+		ASSERT_TRUE(maybeWritten.isOk());
+		EXPECT_EQ(sizeof(header) + sizeof(payload), *maybeWritten);
+	}
+
+	auto const versionAfterWrite = (*vfs.nodeById(nodeId)).version;
+	EXPECT_EQ(sizeof(header) + sizeof(payload), (*vfs.nodeById(nodeId)).dataSize);
+
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::READ);
+	ASSERT_TRUE(maybeFile.isOk());
+
+	char readHeader[4];
+	char readPayload[32];
+	MutableMemoryView const dest[] = {wrapMemory(readHeader), wrapMemory(readPayload)};
+	auto maybeRead = (*maybeFile).readv(arrayView(dest));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(sizeof(header) + sizeof(payload), *maybeRead);
+	EXPECT_EQ(0, memcmp(header, readHeader, sizeof(header)));
+	EXPECT_STREQ(payload, readPayload);
+
+	// Whole batch is read with one driver call that does not modify the node
+	EXPECT_EQ(versionAfterWrite, (*vfs.nodeById(nodeId)).version);
+}
+
+
+TEST_F(RamFSTest, positionalIODoesNotMoveCursor) {
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+
+	char block0[] = {'a', 'a', 'a', 'a'};
+	char block1[] = {'b', 'b', 'b', 'b'};
+	ASSERT_TRUE(file.writeAt(0, wrapMemory(block0)).isOk());
+	ASSERT_TRUE(file.writeAt(4, wrapMemory(block1)).isOk());
+	ASSERT_TRUE(file.writeAt(2, wrapMemory(block1)).isOk());
+	EXPECT_EQ(8U, *file.size());
+
+	char buffer[4];
+	auto maybeRead = file.readAt(4, wrapMemory(buffer));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(4U, *maybeRead);
+	EXPECT_EQ(0, memcmp(block1, buffer, sizeof(buffer)));
+
+	// Cursors are unaffected by positional IO
+	ASSERT_TRUE(file.read(wrapMemory(buffer)).isOk());
+	EXPECT_EQ(0, memcmp("aabb", buffer, sizeof(buffer)));
+
+	ASSERT_TRUE(file.write(wrapMemory(block1)).isOk());
+	ASSERT_TRUE(file.readAt(0, wrapMemory(buffer)).isOk());
+	EXPECT_EQ(0, memcmp(block1, buffer, sizeof(buffer)));
+
+	EXPECT_TRUE(file.readAt(1024, wrapMemory(buffer)).isError());
+}
+
+
+TEST_F(RamFSTest, sharedFileCanBeReadByThreads) {
+	char block[] = {'a', 'b', 'c', 'd'};
+	for (auto sync : {MetadataPolicy::Sync::WriteThrough, MetadataPolicy::Sync::WriteBack}) {
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE,
+								  MetadataPolicy{sync, MetadataPolicy::AccessTime::Strict});
+		ASSERT_TRUE(maybeFile.isOk());
+		auto& file = *maybeFile;
+		ASSERT_TRUE(file.writeAt(0, wrapMemory(block)).isOk());
+
+		std::vector<std::thread> readers;
+		for (int i = 0; i < 4; ++i) {
+			readers.emplace_back([&file, &block]() {
+				for (int j = 0; j < 100; ++j) {
+					char buffer[4];
+					auto maybeRead = file.readAt(0, wrapMemory(buffer));
+					ASSERT_TRUE(maybeRead.isOk());
+					EXPECT_EQ(sizeof(buffer), *maybeRead);
+					EXPECT_EQ(0, memcmp(block, buffer, sizeof(buffer)));
+					EXPECT_TRUE(file.stat().isOk());
+				}
+			});
+		}
+
+		for (auto& reader : readers) {
+			reader.join();
+		}
+
+		file.flush();
+		EXPECT_NE(0U, (*vfs.nodeById(nodeId)).atime);
+	}
+}
+
+
+TEST_F(RamFSTest, borrowedReadDoesNotCopy) {
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+
+	char msg[] = "borrowed-data";
+	ASSERT_TRUE(file.write(wrapMemory(msg)).isOk());
+
+	auto maybeView = file.readBorrowed(8);
+	ASSERT_TRUE(maybeView.isOk());
+	auto view = *maybeView;
+	EXPECT_EQ(8U, view.size());
+	EXPECT_EQ(0, memcmp(msg, view.dataAddress(), view.size()));
+
+	// View points into the driver storage, so it reflects writes in place
+	char update[] = {'B'};
+	ASSERT_TRUE(file.writeAt(0, wrapMemory(update)).isOk());
+	EXPECT_EQ('B', static_cast<char>(view.dataAddress()[0]));
+
+	// Pages never move, so the view stays valid while the file grows
+	char bigBuffer[8192] = {0};
+	EXPECT_TRUE(file.write(wrapMemory(bigBuffer)).isOk());
+	EXPECT_EQ('B', static_cast<char>(view.dataAddress()[0]));
+
+	// Borrowed view does not cross a page boundary
+	auto maybeRestView = file.readBorrowed(8192);
+	ASSERT_TRUE(maybeRestView.isOk());
+	EXPECT_EQ(PagePool::kPageSize - 8, (*maybeRestView).size());
+
+	EXPECT_TRUE(file.releaseBorrowed(view).isOk());
+	EXPECT_TRUE(file.releaseBorrowed(*maybeRestView).isOk());
+	EXPECT_TRUE(file.releaseBorrowed(view).isError());
+}
+
+
+TEST_F(RamFSTest, onlyBorrowedViewsCanBeReleased) {
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::READ | Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+
+	char msg[] = "borrowed-data";
+	ASSERT_TRUE(file.write(wrapMemory(msg)).isOk());
+
+	auto maybeOtherFile = vfs.open(owner, nodeId, Permissions::READ);
+	ASSERT_TRUE(maybeOtherFile.isOk());
+	auto& otherFile = *maybeOtherFile;
+
+	auto maybeView = file.readBorrowed(4);
+	ASSERT_TRUE(maybeView.isOk());
+	auto maybeOtherView = otherFile.readBorrowed(4);
+	ASSERT_TRUE(maybeOtherView.isOk());
+
+	// A view can not be released twice, by a file that did not borrow it, or if it was never borrowed
+	EXPECT_TRUE(file.releaseBorrowed(*maybeView).isOk());
+	EXPECT_TRUE(file.releaseBorrowed(*maybeView).isError());
+	EXPECT_TRUE(file.releaseBorrowed(*maybeOtherView).isError());
+	EXPECT_TRUE(file.releaseBorrowed(wrapMemory(msg)).isError());
+
+	// View of the other file is still borrowed until that file releases it
+	EXPECT_TRUE(otherFile.releaseBorrowed(*maybeOtherView).isOk());
+}
+
+
+TEST_F(RamFSTest, dataSpansMultiplePages) {
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+
+	// Append in chunks that do not align with pages
+	byte chunk[1000];
+	for (uint32 i = 0; i < 10; ++i) {
+		memset(chunk, static_cast<int>('a' + i), sizeof(chunk));
+		ASSERT_TRUE(file.write(wrapMemory(chunk)).isOk());
+	}
+	EXPECT_EQ(10000U, *file.size());
+
+	byte buffer[10000];
+	auto maybeRead = file.readAt(0, wrapMemory(buffer));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(sizeof(buffer), *maybeRead);
+	for (uint32 i = 0; i < sizeof(buffer); ++i) {
+		ASSERT_EQ('a' + i / 1000, buffer[i]);
+	}
+}
+
+
+TEST_F(RamFSTest, writeBeyondCapacityIsNotOk) {
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+
+	std::vector<byte> buffer(kCapacity + 1);
+	EXPECT_TRUE(file.write(wrapMemory(buffer.data(), buffer.size())).isError());
+	EXPECT_EQ(0U, *file.size());
+
+	EXPECT_TRUE(file.write(wrapMemory(buffer.data(), kCapacity)).isOk());
+	EXPECT_EQ(kCapacity, *file.size());
+}
+
+
+TEST_F(RamFSTest, cacheNodesAreEvictedInLeastRecentlyUsedOrder) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+	std::vector<byte> buffer(4 * PagePool::kPageSize, 1);
+
+	INode::Id cacheIds[3] = {{0, 0}, {0, 0}, {0, 0}};
+	char const* names[] = {"cache0", "cache1", "cache2"};
+	for (int i = 0; i < 3; ++i) {
+		auto maybeNodeId = vfs.mknode(vfs.rootId(), names[i], fsId, RamFS::kCacheNodeType, owner);
+		ASSERT_TRUE(maybeNodeId.isOk());
+		cacheIds[i] = *maybeNodeId;
+
+		auto maybeFile = vfs.open(owner, cacheIds[i], Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(buffer.data(), buffer.size())).isOk());
+	}
+
+	// Touch the oldest cache node so that the second one becomes least recently used
+	{
+		auto maybeFile = vfs.open(owner, cacheIds[0], Permissions::READ);
+		ASSERT_TRUE(maybeFile.isOk());
+	}
+
+	// Regular node needs more than what is left of the quota
+	std::vector<byte> overQuota(buffer.size() + 1, 2);
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	ASSERT_TRUE((*maybeFile).write(wrapMemory(overQuota.data(), overQuota.size())).isOk());
+
+	EXPECT_EQ(1U, ramFs->stats().evictions);
+	EXPECT_EQ(buffer.size(), ramFs->stats().bytesReclaimed);
+
+	auto sizeOf = [this](INode::Id id) {
+		auto maybeCacheFile = vfs.open(owner, id, Permissions::READ);
+		return *(*maybeCacheFile).size();
+	};
+
+	EXPECT_EQ(buffer.size(), sizeOf(cacheIds[0]));
+	EXPECT_EQ(0U, sizeOf(cacheIds[1]));
+	EXPECT_EQ(buffer.size(), sizeOf(cacheIds[2]));
+}
+
+
+TEST_F(RamFSTest, evictedCacheNodeReportsItsActualSize) {
+	std::vector<byte> buffer(kCapacity / 2, 1);
+
+	auto maybeCacheId = vfs.mknode(vfs.rootId(), "cache", fsId, RamFS::kCacheNodeType, owner);
+	ASSERT_TRUE(maybeCacheId.isOk());
+
+	auto maybeCacheFile = vfs.open(owner, *maybeCacheId, Permissions::READ | Permissions::WRITE);
+	ASSERT_TRUE(maybeCacheFile.isOk());
+	ASSERT_TRUE((*maybeCacheFile).write(wrapMemory(buffer.data(), buffer.size())).isOk());
+
+	// Regular node needs all of the quota, evicting the cache node
+	std::vector<byte> overQuota(buffer.size() + 1, 2);
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	ASSERT_TRUE((*maybeFile).write(wrapMemory(overQuota.data(), overQuota.size())).isOk());
+
+	EXPECT_EQ(0U, (*vfs.nodeById(*maybeCacheId)).dataSize);
+	EXPECT_EQ(0U, *(*maybeCacheFile).size());
+
+	INode::size_type walkedSize = buffer.size();
+	std::vector<StringView> const path{StringView{"cache"}};
+	ASSERT_TRUE(vfs.walk(owner, vfs.rootId(), path, [&walkedSize](Entry const&, INode const& node) {
+		walkedSize = node.dataSize;
+	}).isOk());
+	EXPECT_EQ(0U, walkedSize);
+
+	// Reading content that has been evicted is the end of file rather than an error
+	byte readBuffer[16];
+	auto maybeRead = (*maybeCacheFile).readAt(10, wrapMemory(readBuffer));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(0U, *maybeRead);
+}
+
+
+TEST_F(RamFSTest, regularNodesAreNeverEvicted) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+	std::vector<byte> buffer(kCapacity / 2, 1);
+
+	auto maybeOtherId = vfs.mknode(vfs.rootId(), "other", fsId, RamFS::kNodeType, owner);
+	ASSERT_TRUE(maybeOtherId.isOk());
+	{
+		auto maybeFile = vfs.open(owner, *maybeOtherId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(buffer.data(), buffer.size())).isOk());
+	}
+
+	std::vector<byte> overQuota(buffer.size() + 1, 2);
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto maybeWritten = (*maybeFile).write(wrapMemory(overQuota.data(), overQuota.size()));
+	ASSERT_TRUE(maybeWritten.isError());
+	EXPECT_EQ(0U, ramFs->stats().evictions);
+	EXPECT_EQ(buffer.size(), (*vfs.nodeById(*maybeOtherId)).dataSize);
+}
+
+
+TEST_F(RamFSTest, idleDataIsCompressedAndDecompressedOnAccess) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	std::string text;
+	while (text.size() < 8 * PagePool::kPageSize) {
+		text += "{\"key\": \"value\", \"count\": 42}\n";
+	}
+
+	{
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(text.data(), text.size())).isOk());
+	}
+
+	auto const pagesInUse = ramFs->pool().pagesInUse();
+	EXPECT_EQ(1U, ramFs->compressIdle(0));
+	EXPECT_EQ(0U, ramFs->compressIdle(0));  // Already compressed
+	EXPECT_GT(pagesInUse, ramFs->pool().pagesInUse());
+
+	auto const node = *vfs.nodeById(nodeId);
+	auto stats = ramFs->dataStats(node);
+	ASSERT_TRUE(stats.isSome());
+	EXPECT_TRUE((*stats).isCompressed);
+	EXPECT_EQ(text.size(), (*stats).size);
+	EXPECT_EQ(text.size(), node.dataSize);
+
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::READ);
+	ASSERT_TRUE(maybeFile.isOk());
+	std::vector<char> buffer(text.size());
+	auto maybeRead = (*maybeFile).read(wrapMemory(buffer.data(), buffer.size()));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(text.size(), *maybeRead);
+	EXPECT_EQ(0, memcmp(text.data(), buffer.data(), text.size()));
+
+	stats = ramFs->dataStats(node);
+	EXPECT_FALSE((*stats).isCompressed);
+	EXPECT_EQ(1U, (*stats).compressions);
+	EXPECT_EQ(1U, (*stats).decompressions);
+	EXPECT_EQ(pagesInUse, ramFs->pool().pagesInUse());
+}
+
+
+TEST(TestRamFSDeduplication, identicalPagesAreShared) {
+	User owner{0, 0};
+	Vfs vfs{owner, FilePermissions{0777}};
+	auto maybeFsId = vfs.registerFilesystem<RamFS>(16 * PagePool::kPageSize, RamFS::Deduplication::On);
+	ASSERT_TRUE(maybeFsId.isOk());
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(*maybeFsId));
+
+	std::vector<byte> content(4 * PagePool::kPageSize + 100);
+	for (std::size_t i = 0; i < content.size(); ++i) {
+		content[i] = static_cast<byte>(i / PagePool::kPageSize + 1);
+	}
+
+	INode::Id ids[2] = {{0, 0}, {0, 0}};
+	char const* names[] = {"copy0", "copy1"};
+	for (int i = 0; i < 2; ++i) {
+		auto maybeNodeId = vfs.mknode(vfs.rootId(), names[i], *maybeFsId, RamFS::kNodeType, owner);
+		ASSERT_TRUE(maybeNodeId.isOk());
+		ids[i] = *maybeNodeId;
+
+		auto maybeFile = vfs.open(owner, ids[i], Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(content.data(), content.size())).isOk());
+	}
+
+	// Full pages are shared, the last partial page of each file is not
+	EXPECT_EQ(4U, ramFs->stats().sharedPages);
+	EXPECT_EQ(6U, ramFs->pool().pagesInUse());
+
+	// Write to a shared page copies it
+	{
+		auto maybeFile = vfs.open(owner, ids[1], Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		byte update[] = {0xFF};
+		ASSERT_TRUE((*maybeFile).writeAt(PagePool::kPageSize, wrapMemory(update)).isOk());
+	}
+	EXPECT_EQ(1U, ramFs->stats().copiesOnWrite);
+	EXPECT_EQ(7U, ramFs->pool().pagesInUse());
+
+	std::vector<byte> buffer(content.size());
+	{
+		auto maybeFile = vfs.open(owner, ids[0], Permissions::READ);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).read(wrapMemory(buffer.data(), buffer.size())).isOk());
+		EXPECT_EQ(content, buffer);
+	}
+	{
+		auto maybeFile = vfs.open(owner, ids[1], Permissions::READ);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).read(wrapMemory(buffer.data(), buffer.size())).isOk());
+		EXPECT_EQ(0xFF, buffer[PagePool::kPageSize]);
+		buffer[PagePool::kPageSize] = content[PagePool::kPageSize];
+		EXPECT_EQ(content, buffer);
+	}
+}
+
+
+TEST(TestRamFSSharedMemory, pagesOfNodeCanBeReadFromPoolFile) {
+	User owner{0, 0};
+	Vfs vfs{owner, FilePermissions{0777}};
+	auto maybeFsId = vfs.registerFilesystem<RamFS>(16 * PagePool::kPageSize, RamFS::Deduplication::Off,
+												   PagePool::Backing::SharedMemory);
+	ASSERT_TRUE(maybeFsId.isOk());
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(*maybeFsId));
+
+	auto maybeNodeId = vfs.mknode(vfs.rootId(), "shared", *maybeFsId, RamFS::kNodeType, owner);
+	ASSERT_TRUE(maybeNodeId.isOk());
+
+	std::string text(PagePool::kPageSize + 10, 'x');
+	text.back() = 'y';
+	{
+		auto maybeFile = vfs.open(owner, *maybeNodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(text.data(), text.size())).isOk());
+	}
+
+	auto node = *vfs.nodeById(*maybeNodeId);
+	auto maybeOffsets = ramFs->pageOffsets(node);
+	if (ramFs->pool().backing() == PagePool::Backing::Heap) {
+		EXPECT_TRUE(maybeOffsets.isError());
+		return;  // Shared memory is not supported by the system
+	}
+
+	ASSERT_TRUE(maybeOffsets.isOk());
+	ASSERT_EQ(2U, (*maybeOffsets).size());
+
+	char value = 0;
+	ASSERT_EQ(1, pread(ramFs->pool().fd(), &value, 1, static_cast<off_t>((*maybeOffsets)[1] + 9)));
+	EXPECT_EQ('y', value);
+}
+
+
+TEST(TestRamFSSharedMemory, reusedPagesDoNotExposeContentOfOtherFiles) {
+	User owner{0, 0};
+	Vfs vfs{owner, FilePermissions{0777}};
+	auto maybeFsId = vfs.registerFilesystem<RamFS>(2 * PagePool::kPageSize, RamFS::Deduplication::Off,
+												   PagePool::Backing::SharedMemory);
+	ASSERT_TRUE(maybeFsId.isOk());
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(*maybeFsId));
+	if (ramFs->pool().backing() == PagePool::Backing::Heap) {
+		return;  // Shared memory is not supported by the system
+	}
+
+	auto maybeOldId = vfs.mknode(vfs.rootId(), "old", *maybeFsId, RamFS::kNodeType, owner);
+	ASSERT_TRUE(maybeOldId.isOk());
+	{
+		std::string text(2 * PagePool::kPageSize, 'x');
+		auto maybeFile = vfs.open(owner, *maybeOldId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(text.data(), text.size())).isOk());
+	}
+	ASSERT_TRUE(vfs.unlink(owner, vfs.rootId(), "old").isOk());
+	ASSERT_EQ(1U, vfs.reclaim());
+
+	// Pages of the new file are the pages of the old one
+	auto maybeNodeId = vfs.mknode(vfs.rootId(), "new", *maybeFsId, RamFS::kNodeType, owner);
+	ASSERT_TRUE(maybeNodeId.isOk());
+	{
+		std::string text(PagePool::kPageSize + 10, 'y');
+		auto maybeFile = vfs.open(owner, *maybeNodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(text.data(), text.size())).isOk());
+	}
+
+	auto node = *vfs.nodeById(*maybeNodeId);
+	auto maybeOffsets = ramFs->pageOffsets(node);
+	ASSERT_TRUE(maybeOffsets.isOk());
+	ASSERT_EQ(2U, (*maybeOffsets).size());
+
+	std::vector<char> page(PagePool::kPageSize);
+	ASSERT_EQ(static_cast<ssize_t>(page.size()),
+			  pread(ramFs->pool().fd(), page.data(), page.size(), static_cast<off_t>((*maybeOffsets)[1])));
+	EXPECT_EQ(std::string(10, 'y'), std::string(page.data(), 10));
+	EXPECT_EQ(std::string(page.size() - 10, '\0'), std::string(page.data() + 10, page.size() - 10));
+}
+
+
+TEST_F(RamFSTest, snapshotKeepsContentAsItWasWhenTaken) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	std::vector<byte> content(3 * PagePool::kPageSize, 'a');
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+	ASSERT_TRUE(file.write(wrapMemory(content.data(), content.size())).isOk());
+
+	auto const pagesInUse = ramFs->pool().pagesInUse();
+	auto snapshot = ramFs->snapshot();
+	EXPECT_EQ(pagesInUse, ramFs->pool().pagesInUse());  // Nothing is copied until content changes
+
+	// Only the modified page is copied
+	byte update[] = {'b', 'b'};
+	ASSERT_TRUE(file.writeAt(PagePool::kPageSize, wrapMemory(update)).isOk());
+	EXPECT_EQ(pagesInUse + 1, ramFs->pool().pagesInUse());
+
+	// File that did not exist at the time of the snapshot is not in the snapshot
+	auto maybeNewId = vfs.mknode(vfs.rootId(), "new", fsId, RamFS::kNodeType, owner);
+	ASSERT_TRUE(maybeNewId.isOk());
+	EXPECT_TRUE(snapshot.size(*vfs.nodeById(*maybeNewId)).isNone());
+
+	auto const node = *vfs.nodeById(nodeId);
+	ASSERT_TRUE(snapshot.size(node).isSome());
+	EXPECT_EQ(content.size(), *snapshot.size(node));
+
+	std::vector<byte> buffer(content.size());
+	auto maybeRead = snapshot.read(node, 0, wrapMemory(buffer.data(), buffer.size()));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(content.size(), *maybeRead);
+	EXPECT_EQ(content, buffer);
+
+	ASSERT_TRUE(file.readAt(PagePool::kPageSize, wrapMemory(buffer.data(), 2)).isOk());
+	EXPECT_EQ('b', buffer[0]);
+
+	// Pages captured by the snapshot are released with the snapshot
+	{
+		auto released = std::move(snapshot);
+	}
+	EXPECT_EQ(pagesInUse, ramFs->pool().pagesInUse());
+}
+
+
+TEST_F(RamFSTest, dataIsNotCompressedWithoutRoomForCompressedCopy) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	std::string text;
+	while (text.size() < kCapacity) {
+		text += "{\"key\": \"value\", \"count\": 42}\n";
+	}
+	text.resize(kCapacity);
+
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::READ | Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	ASSERT_TRUE((*maybeFile).write(wrapMemory(text.data(), text.size())).isOk());
+
+	// Original pages are kept until the compressed copy is stored, and the pool has no room left for it
+	EXPECT_EQ(0U, ramFs->compressIdle(0));
+
+	std::vector<char> buffer(text.size());
+	auto maybeRead = (*maybeFile).readAt(0, wrapMemory(buffer.data(), buffer.size()));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(text.size(), *maybeRead);
+	EXPECT_EQ(0, memcmp(text.data(), buffer.data(), text.size()));
+}
+
+
+TEST_F(RamFSTest, compressedContentOfSnapshotIsReadInChunks) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	std::string text;
+	while (text.size() < 8 * PagePool::kPageSize) {
+		text += "{\"key\": \"value\", \"count\": 42}\n";
+	}
+
+	{
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(text.data(), text.size())).isOk());
+	}
+	EXPECT_EQ(1U, ramFs->compressIdle(0));
+
+	auto const pagesInUse = ramFs->pool().pagesInUse();
+	auto snapshot = ramFs->snapshot();
+	auto const node = *vfs.nodeById(nodeId);
+
+	std::vector<char> buffer(text.size());
+	RamFS::size_type const chunkSize = 1000;
+	for (RamFS::size_type offset = 0; offset < text.size(); offset += chunkSize) {
+		auto const readSize = std::min<RamFS::size_type>(chunkSize, text.size() - offset);
+		auto maybeRead = snapshot.read(node, offset, wrapMemory(buffer.data() + offset, readSize));
+		ASSERT_TRUE(maybeRead.isOk());
+		EXPECT_EQ(readSize, *maybeRead);
+	}
+	EXPECT_EQ(0, memcmp(text.data(), buffer.data(), text.size()));
+
+	// Reading the snapshot leaves content of the file compressed
+	auto const stats = ramFs->dataStats(node);
+	EXPECT_TRUE((*stats).isCompressed);
+	EXPECT_EQ(0U, (*stats).decompressions);
+	EXPECT_EQ(pagesInUse, ramFs->pool().pagesInUse());
+}
+
+
+TEST_F(RamFSTest, adoptedBufferBecomesContentWithoutCopying) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	RamFS::Buffer buffer(2 * PagePool::kPageSize + 1, 'z');
+	auto const* bufferAddress = buffer.data();
+	auto const bufferSize = buffer.size();
+
+	auto maybeAdopted = vfs.modifyNode(nodeId, [&](INode& node) { return ramFs->adopt(node, std::move(buffer)); });
+	ASSERT_TRUE(maybeAdopted.isSome());
+	ASSERT_TRUE((*maybeAdopted).isOk());
+	EXPECT_EQ(bufferSize, (*vfs.nodeById(nodeId)).dataSize);
+	EXPECT_EQ(0U, ramFs->pool().pagesInUse());
+
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+
+	auto maybeView = file.readBorrowed(bufferSize);
+	ASSERT_TRUE(maybeView.isOk());
+	EXPECT_EQ(bufferAddress, (*maybeView).dataAddress());
+	EXPECT_EQ(bufferSize, (*maybeView).size());
+	ASSERT_TRUE(file.releaseBorrowed(*maybeView).isOk());
+
+	// Writing copies content into pages
+	byte update[] = {'a'};
+	ASSERT_TRUE(file.writeAt(0, wrapMemory(update)).isOk());
+	EXPECT_EQ(3U, ramFs->pool().pagesInUse());
+
+	char readBack[2];
+	ASSERT_TRUE(file.readAt(0, wrapMemory(readBack)).isOk());
+	EXPECT_EQ('a', readBack[0]);
+	EXPECT_EQ('z', readBack[1]);
+}
+
+
+TEST_F(RamFSTest, adoptingBufferBeyondCapacityIsNotOk) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	RamFS::Buffer buffer(kCapacity + 1);
+	auto maybeAdopted = vfs.modifyNode(nodeId, [&](INode& node) { return ramFs->adopt(node, std::move(buffer)); });
+	ASSERT_TRUE(maybeAdopted.isSome());
+	EXPECT_TRUE((*maybeAdopted).isError());
+
+	// Adopted buffer takes capacity away from pages
+	RamFS::Buffer halfBuffer(kCapacity / 2);
+	auto maybeHalfAdopted = vfs.modifyNode(nodeId, [&](INode& node) {
+		return ramFs->adopt(node, std::move(halfBuffer));
+	});
+	ASSERT_TRUE(maybeHalfAdopted.isSome());
+	ASSERT_TRUE((*maybeHalfAdopted).isOk());
+
+	auto maybeOtherId = vfs.mknode(vfs.rootId(), "other", fsId, RamFS::kNodeType, owner);
+	ASSERT_TRUE(maybeOtherId.isOk());
+	auto maybeFile = vfs.open(owner, *maybeOtherId, Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+
+	std::vector<byte> data(kCapacity / 2 + 1);
+	EXPECT_TRUE((*maybeFile).write(wrapMemory(data.data(), data.size())).isError());
+	EXPECT_TRUE((*maybeFile).write(wrapMemory(data.data(), data.size() - 1)).isOk());
+}
+
+
+TEST_F(RamFSTest, writingToAdoptedBufferLargerThanHalfOfCapacityIsOk) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	RamFS::Buffer buffer(kCapacity / 2 + 2 * PagePool::kPageSize, 'z');  // Whole number of pages
+	auto const bufferSize = buffer.size();
+	auto maybeAdopted = vfs.modifyNode(nodeId, [&](INode& node) { return ramFs->adopt(node, std::move(buffer)); });
+	ASSERT_TRUE(maybeAdopted.isSome());
+	ASSERT_TRUE((*maybeAdopted).isOk());
+
+	// Buffer is copied into pages taking its place
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::READ | Permissions::WRITE);
+	ASSERT_TRUE(maybeFile.isOk());
+	auto& file = *maybeFile;
+	byte update[] = {'a'};
+	ASSERT_TRUE(file.writeAt(0, wrapMemory(update)).isOk());
+
+	auto const stats = ramFs->dataStats(*vfs.nodeById(nodeId));
+	ASSERT_TRUE(stats.isSome());
+	EXPECT_EQ(bufferSize, (*stats).size);
+	EXPECT_EQ(bufferSize, (*stats).storedBytes);
+
+	byte readBack[2];
+	ASSERT_TRUE(file.readAt(0, wrapMemory(readBack)).isOk());
+	EXPECT_EQ('a', readBack[0]);
+	EXPECT_EQ('z', readBack[1]);
+
+	// Capacity of the buffer is returned once it is released
+	auto maybeOtherId = vfs.mknode(vfs.rootId(), "other", fsId, RamFS::kNodeType, owner);
+	ASSERT_TRUE(maybeOtherId.isOk());
+	auto maybeOtherFile = vfs.open(owner, *maybeOtherId, Permissions::WRITE);
+	ASSERT_TRUE(maybeOtherFile.isOk());
+
+	std::vector<byte> data(kCapacity - bufferSize);
+	EXPECT_TRUE((*maybeOtherFile).write(wrapMemory(data.data(), data.size())).isOk());
+}
+
+
+TEST_F(RamFSTest, pagesOfUnlinkedNodeAreReclaimed) {
+	auto* ramFs = static_cast<RamFS*>(*vfs.findFs(fsId));
+
+	std::vector<byte> content(2 * PagePool::kPageSize);
+	{
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		ASSERT_TRUE((*maybeFile).write(wrapMemory(content.data(), content.size())).isOk());
+
+		ASSERT_TRUE(vfs.unlink(owner, vfs.rootId(), "data").isOk());
+		EXPECT_EQ(0U, vfs.reclaimStats().pending);  // Node is still open
+	}
+
+	EXPECT_EQ(1U, vfs.reclaimStats().pending);
+	EXPECT_EQ(2U, ramFs->pool().pagesInUse());
+
+	EXPECT_EQ(1U, vfs.reclaim());
+	EXPECT_EQ(0U, ramFs->pool().pagesInUse());
+}
@@ -16,6 +16,12 @@
 #include <gtest/gtest.h>
 #include <solace/output_utils.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
 
 using namespace kasofs;
 using namespace Solace;
@@ -46,6 +52,9 @@ struct MockFs : public Filesystem {
 	}
 
 	kasofs::Result<void> destroyNode(INode&) override {
+		if (_isDestroyFailing)
+			return makeError(GenericError::IO, "MockFs::destroyNode");
+
 		_nDestroyed += 1;
 		return Ok();
 	}
@@ -99,13 +108,16 @@ struct MockFs : public Filesystem {
 	auto filesOpen() const noexcept { return _nOpened; }
 	auto filesClosed() const noexcept { return _nClosed; }
 	auto nodesCreated() const noexcept { return _nCreated; }
-	auto nodesDestroyed() const noexcept { return _nCreated; }
+	auto nodesDestroyed() const noexcept { return _nDestroyed; }
+
+	void failDestroy(bool isFailing) noexcept { _isDestroyFailing = isFailing; }
 
 private:
 	std::string buffer;
 
 	uint32 _nCreated{0};
 	uint32 _nDestroyed{0};
+	bool _isDestroyFailing{false};
 
 	uint32 _nOpened{0};
 	uint32 _nClosed{0};
@@ -158,7 +170,8 @@ struct MockFsTest : public ::testing::Test {
 
 	void TearDown() override {
 		EXPECT_EQ(_mockFs->filesOpen(), _mockFs->filesClosed());
-		EXPECT_EQ(_mockFs->nodesCreated(), _mockFs->nodesDestroyed());
+		// Nodes still linked when the test ends are never destroyed
+		EXPECT_LE(_mockFs->nodesDestroyed(), _mockFs->nodesCreated());
 	}
 
 protected:
@@ -231,6 +244,35 @@ TEST(TestVfs, testMountingRO_FS) {
 */
 
 
+TEST_F(MockFsTest, unregisteringFilesystemInUseIsNotOk) {
+	// Fixture's driver is checked when the test ends, so a driver of its own is unregistered
+	auto maybeFsId = vfs.registerFilesystem<MockFs>("unregistered");
+	ASSERT_TRUE(maybeFsId.isOk());
+	auto const otherFsId = *maybeFsId;
+
+	auto maybeId = vfs.mknode(vfs.rootId(), "id", otherFsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeId.isOk());
+
+	{
+		auto maybeOpenedFile = vfs.open(owner, *maybeId, Permissions::READ);
+		ASSERT_TRUE(maybeOpenedFile.isOk());
+		EXPECT_TRUE(vfs.unregisterFileSystem(otherFsId).isError());
+		EXPECT_TRUE(vfs.findFs(otherFsId).isSome());
+	}
+
+	EXPECT_TRUE(vfs.unregisterFileSystem(otherFsId).isOk());
+	EXPECT_TRUE(vfs.findFs(otherFsId).isNone());
+	EXPECT_TRUE(vfs.unregisterFileSystem(otherFsId).isError());
+	EXPECT_TRUE(vfs.unregisterFileSystem(1024).isError());
+
+	// Ids of unregistered filesystems are not reused
+	auto maybeNewFsId = vfs.registerFilesystem<MockFs>("other");
+	ASSERT_TRUE(maybeNewFsId.isOk());
+	EXPECT_NE(otherFsId, *maybeNewFsId);
+	EXPECT_TRUE(vfs.findFs(*maybeNewFsId).isSome());
+}
+
+
 TEST_F(MockFsTest, linkingNodesToDirecotryIsOk) {
 	auto maybeId = vfs.mknode(vfs.rootId(), "id", fsId, MockFs::dataType(), owner);
 	ASSERT_TRUE(maybeId.isOk());
@@ -338,6 +380,138 @@ TEST_F(MockFsTest, unlinkingNodeRemovesNodeWithNoRefTo) {
 }
 
 
+TEST_F(MockFsTest, unlinkingNodeKeepsOtherIdsValid) {
+	auto maybeId1 = vfs.mknode(vfs.rootId(), "id-1", fsId, MockFs::dataType(), owner);
+	auto maybeId2 = vfs.mknode(vfs.rootId(), "id-2", fsId, MockFs::dataType(), owner);
+	auto maybeId3 = vfs.mknode(vfs.rootId(), "id-3", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeId1.isOk());
+	ASSERT_TRUE(maybeId2.isOk());
+	ASSERT_TRUE(maybeId3.isOk());
+
+	EXPECT_TRUE(vfs.unlink(owner, vfs.rootId(), "id-2").isOk());
+	EXPECT_EQ(3U, vfs.size());
+
+	EXPECT_TRUE(vfs.nodeById(*maybeId1).isSome());
+	EXPECT_TRUE(vfs.nodeById(*maybeId2).isNone());
+	EXPECT_TRUE(vfs.nodeById(*maybeId3).isSome());
+}
+
+
+TEST_F(MockFsTest, releasedNodeSlotIsReusedWithNewGeneration) {
+	auto maybeId = vfs.mknode(vfs.rootId(), "id", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeId.isOk());
+	EXPECT_TRUE(vfs.unlink(owner, vfs.rootId(), "id").isOk());
+	EXPECT_EQ(1U, vfs.reclaim());
+
+	auto maybeNewId = vfs.mknode(vfs.rootId(), "id-new", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNewId.isOk());
+	EXPECT_EQ(2U, vfs.size());
+
+	// Slot is reused, but the stale Id must not resolve to the new node
+	EXPECT_EQ((*maybeId).index, (*maybeNewId).index);
+	EXPECT_NE((*maybeId).gen, (*maybeNewId).gen);
+	EXPECT_TRUE(vfs.nodeById(*maybeId).isNone());
+	EXPECT_TRUE(vfs.nodeById(*maybeNewId).isSome());
+	EXPECT_TRUE(vfs.link(owner, "id-stale", vfs.rootId(), *maybeId).isError());
+}
+
+
+TEST_F(MockFsTest, nodeIsAccessedInPlace) {
+	auto maybeId = vfs.mknode(vfs.rootId(), "id", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeId.isOk());
+
+	auto const versionBefore = (*vfs.nodeById(*maybeId)).version;
+	auto maybeSize = vfs.modifyNode(*maybeId, [](INode& node) {
+		node.dataSize = 42;
+		return node.dataSize;
+	});
+	ASSERT_TRUE(maybeSize.isSome());
+	EXPECT_EQ(42U, *maybeSize);
+
+	auto maybeNodeInfo = vfs.withNode(*maybeId, [](INode const& node) { return std::make_pair(node.dataSize, node.version); });
+	ASSERT_TRUE(maybeNodeInfo.isSome());
+	EXPECT_EQ(42U, (*maybeNodeInfo).first);
+	EXPECT_EQ(versionBefore + 1, (*maybeNodeInfo).second);
+
+	EXPECT_TRUE(vfs.withNode(INode::Id{1024, 0}, [](INode const&) { return true; }).isNone());
+	EXPECT_TRUE(vfs.modifyNode(INode::Id{1024, 0}, [](INode&) { return true; }).isNone());
+}
+
+
+TEST_F(MockFsTest, slotOfUnlinkedOpenNodeIsHeldUntilClosed) {
+	auto maybeId = vfs.mknode(vfs.rootId(), "id", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeId.isOk());
+
+	{
+		auto maybeOpenedFile = vfs.open(owner, *maybeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeOpenedFile.isOk());
+		EXPECT_TRUE(vfs.unlink(owner, vfs.rootId(), "id").isOk());
+		EXPECT_EQ(1U, vfs.size());
+
+		// Orphaned slot must not be reused while the file is open
+		auto maybeOtherId = vfs.mknode(vfs.rootId(), "other", fsId, MockFs::dataType(), owner);
+		ASSERT_TRUE(maybeOtherId.isOk());
+		EXPECT_NE((*maybeId).index, (*maybeOtherId).index);
+
+		EXPECT_TRUE((*maybeOpenedFile).stat().isOk());
+		EXPECT_EQ(0U, vfs.reclaim());
+	}
+
+	EXPECT_EQ(1U, vfs.reclaim());
+	auto maybeNewId = vfs.mknode(vfs.rootId(), "id-new", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNewId.isOk());
+	EXPECT_EQ((*maybeId).index, (*maybeNewId).index);
+	EXPECT_TRUE(vfs.nodeById(*maybeId).isNone());
+}
+
+
+TEST_F(MockFsTest, unlinkedNodesAreDestroyedInBatches) {
+	char const* names[] = {"id0", "id1", "id2"};
+	for (auto name : names) {
+		ASSERT_TRUE(vfs.mknode(vfs.rootId(), name, fsId, MockFs::dataType(), owner).isOk());
+	}
+
+	for (auto name : names) {
+		ASSERT_TRUE(vfs.unlink(owner, vfs.rootId(), name).isOk());
+	}
+
+	EXPECT_EQ(0U, _mockFs->nodesDestroyed());
+	EXPECT_EQ(3U, vfs.reclaimStats().pending);
+
+	EXPECT_EQ(2U, vfs.reclaim(2));
+	EXPECT_EQ(2U, _mockFs->nodesDestroyed());
+	EXPECT_EQ(1U, vfs.reclaimStats().pending);
+	EXPECT_EQ(2U, vfs.reclaimStats().reclaimed);
+
+	EXPECT_EQ(1U, vfs.reclaim());
+	EXPECT_EQ(0U, vfs.reclaim());
+	EXPECT_EQ(3U, _mockFs->nodesDestroyed());
+	EXPECT_EQ(0U, vfs.reclaimStats().pending);
+	EXPECT_EQ(0U, vfs.reclaimStats().failed);
+}
+
+
+TEST_F(MockFsTest, nodesDriverFailedToDestroyAreNotCountedAsReclaimed) {
+	char const* names[] = {"id0", "id1"};
+	for (auto name : names) {
+		ASSERT_TRUE(vfs.mknode(vfs.rootId(), name, fsId, MockFs::dataType(), owner).isOk());
+	}
+
+	ASSERT_TRUE(vfs.unlink(owner, vfs.rootId(), names[0]).isOk());
+	_mockFs->failDestroy(true);
+	EXPECT_EQ(0U, vfs.reclaim());
+	EXPECT_EQ(1U, vfs.reclaimStats().failed);
+	EXPECT_EQ(0U, vfs.reclaimStats().reclaimed);
+	EXPECT_EQ(0U, vfs.reclaimStats().pending);
+
+	ASSERT_TRUE(vfs.unlink(owner, vfs.rootId(), names[1]).isOk());
+	_mockFs->failDestroy(false);
+	EXPECT_EQ(1U, vfs.reclaim());
+	EXPECT_EQ(1U, vfs.reclaimStats().failed);
+	EXPECT_EQ(1U, vfs.reclaimStats().reclaimed);
+}
+
+
 TEST_F(MockFsTest, unlinkingNonExistingNameIsNoop) {
 	auto maybeId = vfs.mknode(vfs.rootId(), "id", fsId, MockFs::dataType(), owner);
 	ASSERT_TRUE(maybeId.isOk());
@@ -712,6 +886,269 @@ TEST_F(MockFsTest, testWalk) {
 }
 
 
+TEST_F(MockFsTest, testWalkStringPath) {
+	auto maybeDirId0 = vfs.createDirectory(vfs.rootId(), "dir0", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId0.isOk());
+	auto maybeDirId1 = vfs.createDirectory(*maybeDirId0, "dir1", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId1.isOk());
+	auto maybeDataId = vfs.mknode(*maybeDirId1, "data", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeDataId.isOk());
+
+	for (auto path : {"dir0/dir1/data", "/dir0//dir1/data", "./dir0/dir1/./data", "dir0/../dir0/dir1/data"}) {
+		auto maybeEntry = vfs.walk(owner, vfs.rootId(), StringView{path});
+		ASSERT_TRUE(maybeEntry.isOk()) << path;
+		EXPECT_EQ(*maybeDataId, (*maybeEntry).nodeId) << path;
+		EXPECT_EQ("data", (*maybeEntry).name) << path;
+	}
+
+	{  // Parent of the start node is the start node itself
+		auto maybeEntry = vfs.walk(owner, *maybeDirId0, StringView{"../../dir1"});
+		ASSERT_TRUE(maybeEntry.isOk());
+		EXPECT_EQ(*maybeDirId1, (*maybeEntry).nodeId);
+	}
+
+	{
+		auto maybeEntry = vfs.walk(owner, vfs.rootId(), StringView{"dir0/dir1/.."});
+		ASSERT_TRUE(maybeEntry.isOk());
+		EXPECT_EQ(*maybeDirId0, (*maybeEntry).nodeId);
+		EXPECT_EQ("dir0", (*maybeEntry).name);
+	}
+
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), StringView{"dir0/data"}).isError());
+
+	constexpr StaticPath kDataPath{"dir0/dir1/data"};
+	auto maybeEntry = vfs.walk(owner, vfs.rootId(), kDataPath);
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(*maybeDataId, (*maybeEntry).nodeId);
+
+	// String paths and literals are served by the dentry cache too
+	vfs.enableDentryCache(16);
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), StringView{"dir0/dir1/data"}).isOk());
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), kDataPath).isOk());
+	EXPECT_EQ(1U, (*vfs.dentryCacheStats()).hits);
+}
+
+
+TEST_F(MockFsTest, testWalkParentBeyondTrail) {
+	std::vector<INode::Id> dirIds{vfs.rootId()};
+	std::string path;
+	for (int i = 0; i < 40; ++i) {
+		auto maybeDirId = vfs.createDirectory(dirIds.back(), "d", owner, FilePermissions{0777});
+		ASSERT_TRUE(maybeDirId.isOk());
+		dirIds.push_back(*maybeDirId);
+		path += "d/";
+	}
+
+	auto const walk = [this](std::string const& p) {
+		return vfs.walk(owner, vfs.rootId(), StringView{p.data(), static_cast<StringView::size_type>(p.size())});
+	};
+
+	auto maybeEntry = walk(path);
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(dirIds[40], (*maybeEntry).nodeId);
+
+	// Only a limited number of directories are remembered: older ones are resolved again
+	path += "../../..";
+	maybeEntry = walk(path);
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(dirIds[37], (*maybeEntry).nodeId);
+
+	for (int i = 0; i < 35; ++i) {
+		path += "/..";
+	}
+	maybeEntry = walk(path);
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(dirIds[2], (*maybeEntry).nodeId);
+
+	maybeEntry = walk(path + "/d/d/../..");
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(dirIds[2], (*maybeEntry).nodeId);
+
+	maybeEntry = walk(path + "/../../../..");
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(vfs.rootId(), (*maybeEntry).nodeId);
+}
+
+
+TEST_F(MockFsTest, testWalkDotSegmentsAfterFile) {
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "dir", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId.isOk());
+	ASSERT_TRUE(vfs.mknode(*maybeDirId, "data", fsId, MockFs::dataType(), owner).isOk());
+
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), StringView{"dir/data"}).isOk());
+	for (auto path : {"dir/data/.", "dir/data/..", "dir/data/./..", "dir/data/../data"}) {
+		auto maybeEntry = vfs.walk(owner, vfs.rootId(), StringView{path});
+		ASSERT_TRUE(maybeEntry.isError()) << path;
+		EXPECT_EQ(static_cast<int>(GenericError::NOTDIR), maybeEntry.getError().value()) << path;
+	}
+}
+
+
+TEST_F(MockFsTest, testWalkMany) {
+	auto maybeDirId0 = vfs.createDirectory(vfs.rootId(), "dir0", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId0.isOk());
+	auto maybeDirId1 = vfs.createDirectory(*maybeDirId0, "dir1", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId1.isOk());
+	auto maybePrivateId = vfs.createDirectory(vfs.rootId(), "private", owner, FilePermissions{0700});
+	ASSERT_TRUE(maybePrivateId.isOk());
+	auto maybeData0Id = vfs.mknode(*maybeDirId1, "data0", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeData0Id.isOk());
+	auto maybeData1Id = vfs.mknode(*maybeDirId1, "data1", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeData1Id.isOk());
+	auto maybeSecretId = vfs.mknode(*maybePrivateId, "secret", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeSecretId.isOk());
+
+	std::vector<PathSegments> const paths {
+		PathSegments{"dir0/dir1/data1"},
+		PathSegments{"dir0/missing/data0"},
+		PathSegments{"dir0/dir1/data0"},
+		PathSegments{"private/secret"},
+		PathSegments{"dir0/missing/data1"},
+		PathSegments{""},
+		PathSegments{"dir0/dir1"},
+		PathSegments{"dir0/../dir0/dir1/data0"},
+	};
+
+	auto const results = vfs.walkMany(owner, vfs.rootId(), paths);
+	ASSERT_EQ(paths.size(), results.size());
+	for (std::size_t i = 0; i < paths.size(); ++i) {
+		EXPECT_EQ(vfs.walk(owner, vfs.rootId(), paths[i], [](Entry const&, INode const&) {}).isOk(), results[i].isOk())
+				<< i;
+	}
+
+	ASSERT_TRUE(results[0].isOk());
+	EXPECT_EQ(*maybeData1Id, (*results[0]).nodeId);
+	EXPECT_EQ("data1", (*results[0]).name);
+	EXPECT_TRUE(results[1].isError());
+	ASSERT_TRUE(results[2].isOk());
+	EXPECT_EQ(*maybeData0Id, (*results[2]).nodeId);
+	ASSERT_TRUE(results[3].isOk());
+	EXPECT_EQ(*maybeSecretId, (*results[3]).nodeId);
+	EXPECT_TRUE(results[4].isError());
+	ASSERT_TRUE(results[5].isOk());
+	EXPECT_EQ(vfs.rootId(), (*results[5]).nodeId);
+	ASSERT_TRUE(results[6].isOk());
+	EXPECT_EQ(*maybeDirId1, (*results[6]).nodeId);
+	ASSERT_TRUE(results[7].isOk());
+	EXPECT_EQ(*maybeData0Id, (*results[7]).nodeId);
+
+	// Permissions are checked for each user
+	auto const guest = User{9, 1};
+	auto const guestResults = vfs.walkMany(guest, *maybeDirId0, paths);
+	ASSERT_EQ(paths.size(), guestResults.size());
+	for (std::size_t i = 0; i < paths.size(); ++i) {
+		EXPECT_EQ(vfs.walk(guest, *maybeDirId0, paths[i], [](Entry const&, INode const&) {}).isOk(),
+				  guestResults[i].isOk())
+				<< i;
+	}
+
+	auto const badRootResults = vfs.walkMany(owner, INode::Id{1024, 0}, paths);
+	for (auto const& result : badRootResults) {
+		EXPECT_TRUE(result.isError());
+	}
+}
+
+
+TEST_F(MockFsTest, testWalkLargeDirectory) {
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "dir", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId.isOk());
+
+	char name[32];
+	std::vector<INode::Id> ids;
+	for (int i = 0; i < 1000; ++i) {
+		snprintf(name, sizeof(name), "file-%d", i);
+		auto maybeId = vfs.mknode(*maybeDirId, name, fsId, MockFs::dataType(), owner);
+		ASSERT_TRUE(maybeId.isOk());
+		ids.push_back(*maybeId);
+	}
+
+	for (int i = 0; i < 1000; i += 7) {
+		snprintf(name, sizeof(name), "file-%d", i);
+		auto maybeEntry = vfs.walk(owner, vfs.rootId(), *makePath("dir", name));
+		ASSERT_TRUE(maybeEntry.isOk());
+		EXPECT_EQ(ids[i], (*maybeEntry).nodeId);
+		EXPECT_EQ(StringView{name}, (*maybeEntry).name);
+	}
+
+	EXPECT_TRUE(vfs.unlink(owner, *maybeDirId, "file-7").isOk());
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), *makePath("dir", "file-7")).isError());
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), *makePath("dir", "file-1000")).isError());
+}
+
+
+TEST_F(MockFsTest, testWalkWithDentryCache) {
+	vfs.enableDentryCache(64);
+
+	auto maybeDirId0 = vfs.createDirectory(vfs.rootId(), "dir0", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId0.isOk());
+	auto maybeDirId1 = vfs.createDirectory(*maybeDirId0, "dir1", owner, FilePermissions{0700});
+	ASSERT_TRUE(maybeDirId1.isOk());
+	auto maybeDataId = vfs.mknode(*maybeDirId1, "data", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeDataId.isOk());
+
+	auto const path = *makePath("dir0", "dir1", "data");
+	for (int i = 0; i < 3; ++i) {
+		auto maybeEntry = vfs.walk(owner, vfs.rootId(), path);
+		ASSERT_TRUE(maybeEntry.isOk());
+		EXPECT_EQ(*maybeDataId, (*maybeEntry).nodeId);
+		EXPECT_EQ("data", (*maybeEntry).name);
+	}
+
+	auto maybeStats = vfs.dentryCacheStats();
+	ASSERT_TRUE(maybeStats.isSome());
+	EXPECT_EQ(2U, (*maybeStats).hits);
+	EXPECT_EQ(1U, (*maybeStats).misses);
+
+	// Permissions are checked on every cache hit
+	EXPECT_TRUE(vfs.walk(User{9, 1}, vfs.rootId(), path).isError());
+
+	// Re-linking a name on the chain invalidates cached resolution
+	ASSERT_TRUE(vfs.unlink(owner, *maybeDirId1, "data").isOk());
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), path).isError());
+
+	auto maybeNewDataId = vfs.mknode(*maybeDirId1, "data", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNewDataId.isOk());
+	auto maybeEntry = vfs.walk(owner, vfs.rootId(), path);
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(*maybeNewDataId, (*maybeEntry).nodeId);
+	// Both the original resolution and the failed one made after unlink are out of date
+	EXPECT_EQ(2U, (*vfs.dentryCacheStats()).stale);
+}
+
+
+TEST_F(MockFsTest, testWalkMissingNameWithDentryCache) {
+	vfs.enableDentryCache(64);
+
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "etc", owner, FilePermissions{0755});
+	ASSERT_TRUE(maybeDirId.isOk());
+
+	auto const path = *makePath("etc", "override.conf");
+	for (int i = 0; i < 3; ++i) {
+		EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), path).isError());
+	}
+
+	auto maybeStats = vfs.dentryCacheStats();
+	ASSERT_TRUE(maybeStats.isSome());
+	EXPECT_EQ(2U, (*maybeStats).negativeHits);
+	EXPECT_EQ(1U, (*maybeStats).misses);
+
+	// Missing directory on the path is remembered too
+	auto const deepPath = *makePath("etc", "app", "override.conf");
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), deepPath).isError());
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), deepPath).isError());
+	EXPECT_EQ(3U, (*vfs.dentryCacheStats()).negativeHits);
+
+	// Linking the missing name invalidates the negative record
+	auto maybeDataId = vfs.mknode(*maybeDirId, "override.conf", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeDataId.isOk());
+
+	auto maybeEntry = vfs.walk(owner, vfs.rootId(), path);
+	ASSERT_TRUE(maybeEntry.isOk());
+	EXPECT_EQ(*maybeDataId, (*maybeEntry).nodeId);
+	EXPECT_EQ(1U, (*vfs.dentryCacheStats()).stale);
+}
+
+
 TEST_F(MockFsTest, testPremissionsInheritence) {
 	auto maybeNodeId = vfs.mknode(vfs.rootId(), "data", fsId, MockFs::dataType(), owner, FilePermissions{0777});
 	auto maybeNode = vfs.nodeById(maybeNodeId);
@@ -766,6 +1203,131 @@ TEST_F(MockFsTest, testFileWriteUpdatesSize) {
 }
 
 
+TEST_F(MockFsTest, testFileVectoredIOFallsBackToSequentialCalls) {
+	auto maybeNodeId = vfs.mknode(vfs.rootId(), "str1", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNodeId);
+
+	char part1[] = {'o', 't', 'h'};
+	char part2[] = "er";
+	MemoryView const src[] = {wrapMemory(part1), wrapMemory(part2)};
+	{
+		auto maybeFile = vfs.open(owner, *maybeNodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeFile.isOk());
+		auto maybeWritten = (*maybeFile).writev(arrayView(src));
+		ASSERT_TRUE(maybeWritten.isOk());
+		EXPECT_EQ(sizeof(part1) + sizeof(part2), *maybeWritten);
+	}
+
+	auto maybeFile = vfs.open(owner, *maybeNodeId, Permissions::READ);
+	ASSERT_TRUE(maybeFile.isOk());
+
+	char buffer1[2];
+	char buffer2[16];
+	MutableMemoryView const dest[] = {wrapMemory(buffer1), wrapMemory(buffer2)};
+	auto maybeRead = (*maybeFile).readv(arrayView(dest));
+	ASSERT_TRUE(maybeRead.isOk());
+	EXPECT_EQ(sizeof(part1) + sizeof(part2), *maybeRead);
+	EXPECT_EQ('o', buffer1[0]);
+	EXPECT_EQ('t', buffer1[1]);
+	EXPECT_STREQ("her", buffer2);
+}
+
+
+TEST_F(MockFsTest, testFileBorrowingIsNotSupportedByDefault) {
+	auto maybeNodeId = vfs.mknode(vfs.rootId(), "str1", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNodeId);
+
+	auto maybeFile = vfs.open(owner, *maybeNodeId, Permissions::READ);
+	ASSERT_TRUE(maybeFile.isOk());
+	EXPECT_TRUE((*maybeFile).readBorrowed(4).isError());
+}
+
+
+TEST_F(MockFsTest, testFileWriteBackPublishesMetadataOnFlush) {
+	auto maybeNodeId = vfs.mknode(vfs.rootId(), "str1", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNodeId);
+	auto const nodeId = *maybeNodeId;
+	auto const versionBefore = (*vfs.nodeById(nodeId)).version;
+
+	char msg[] = "other-message";
+	{
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE,
+								  MetadataPolicy{MetadataPolicy::Sync::WriteBack, MetadataPolicy::AccessTime::None});
+		ASSERT_TRUE(maybeFile.isOk());
+
+		auto& file = *maybeFile;
+		ASSERT_TRUE(file.write(wrapMemory(msg)).isOk());
+		ASSERT_TRUE(file.write(wrapMemory(msg)).isOk());
+
+		// Index is not touched until the file is flushed, while file sees its own changes
+		EXPECT_EQ(5U, (*vfs.nodeById(nodeId)).dataSize);
+		EXPECT_EQ(versionBefore, (*vfs.nodeById(nodeId)).version);
+		EXPECT_EQ(2 * sizeof(msg), *file.size());
+
+		file.flush();
+		EXPECT_EQ(2 * sizeof(msg), (*vfs.nodeById(nodeId)).dataSize);
+		EXPECT_EQ(versionBefore + 1, (*vfs.nodeById(nodeId)).version);
+
+		ASSERT_TRUE(file.write(wrapMemory(msg)).isOk());
+	}
+
+	// Closing the file publishes the rest
+	EXPECT_EQ(3 * sizeof(msg), (*vfs.nodeById(nodeId)).dataSize);
+}
+
+
+TEST_F(MockFsTest, testFileWriteBackFlushKeepsChangesOfOtherFiles) {
+	auto maybeNodeId = vfs.mknode(vfs.rootId(), "str1", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNodeId);
+	auto const nodeId = *maybeNodeId;
+
+	char msg[] = "other-message";
+	auto maybeFile = vfs.open(owner, nodeId, Permissions::WRITE,
+							  MetadataPolicy{MetadataPolicy::Sync::WriteBack, MetadataPolicy::AccessTime::None});
+	ASSERT_TRUE(maybeFile.isOk());
+	ASSERT_TRUE((*maybeFile).writeAt(0, wrapMemory(msg)).isOk());
+	{  // Another file grows the node and vfs changes its data while the private copy is not published
+		auto maybeOtherFile = vfs.open(owner, nodeId, Permissions::WRITE);
+		ASSERT_TRUE(maybeOtherFile.isOk());
+		ASSERT_TRUE((*maybeOtherFile).writeAt(sizeof(msg), wrapMemory(msg)).isOk());
+		ASSERT_TRUE(vfs.modifyNode(nodeId, [](INode& node) { node.vfsData = 42; return true; }));
+	}
+
+	(*maybeFile).flush();
+	EXPECT_EQ(2 * sizeof(msg), (*vfs.nodeById(nodeId)).dataSize);
+	EXPECT_EQ(42U, (*vfs.nodeById(nodeId)).vfsData);
+}
+
+
+TEST_F(MockFsTest, testFileAccessTimePolicy) {
+	auto maybeNodeId = vfs.mknode(vfs.rootId(), "str1", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNodeId);
+	auto const nodeId = *maybeNodeId;
+
+	char buffer[8];
+	{  // Default policy of a vfs does not update access time
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::READ);
+		ASSERT_TRUE(maybeFile.isOk());
+		auto const versionBefore = (*vfs.nodeById(nodeId)).version;
+		ASSERT_TRUE((*maybeFile).read(wrapMemory(buffer)).isOk());
+		EXPECT_EQ(0U, (*vfs.nodeById(nodeId)).atime);
+		EXPECT_EQ(versionBefore, (*vfs.nodeById(nodeId)).version);  // Reads that don't change the node are not modifications
+	}
+
+	ASSERT_TRUE(vfs.setMetadataPolicy(fsId, MetadataPolicy{MetadataPolicy::Sync::WriteThrough,
+															MetadataPolicy::AccessTime::Relative}).isOk());
+	{
+		auto maybeFile = vfs.open(owner, nodeId, Permissions::READ);
+		ASSERT_TRUE(maybeFile.isOk());
+		EXPECT_EQ(MetadataPolicy::AccessTime::Relative, (*maybeFile).metadataPolicy().atime);
+		ASSERT_TRUE((*maybeFile).read(wrapMemory(buffer)).isOk());
+		EXPECT_NE(0U, (*vfs.nodeById(nodeId)).atime);
+	}
+
+	EXPECT_TRUE(vfs.setMetadataPolicy(1024, MetadataPolicy{}).isError());
+}
+
+
 
 TEST_F(MockFsTest, stringFs) {
 	auto maybeNodeId = vfs.mknode(vfs.rootId(), "str1", fsId, MockFs::dataType(), owner);
@@ -843,3 +1405,299 @@ TEST_F(MockFsTest, creatingDirectoryIsOK) {
 	}
 	EXPECT_EQ(3U, count);
 }
+
+
+TEST_F(MockFsTest, concurrentWalksObserveConsistentDirectory) {
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "dir", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId.isOk());
+	auto const dirId = *maybeDirId;
+	ASSERT_TRUE(vfs.mknode(dirId, "stable", fsId, MockFs::dataType(), owner).isOk());
+	vfs.enableDentryCache(64);
+
+	constexpr int kReaders = 4;
+	constexpr int kIterations = 500;
+	std::atomic<int> nFailedWalks{0};
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < kReaders; ++i) {
+		readers.emplace_back([this, &nFailedWalks]() {
+			for (int j = 0; j < kIterations; ++j) {
+				auto maybeEntry = vfs.walk(owner, vfs.rootId(), StringView{"dir/stable"});
+				if (!maybeEntry || !vfs.nodeById((*maybeEntry).nodeId)) {
+					nFailedWalks += 1;
+				}
+			}
+		});
+	}
+
+	// Directory being walked is modified meanwhile
+	for (int j = 0; j < kIterations; ++j) {
+		EXPECT_TRUE(vfs.mknode(dirId, "transient", fsId, MockFs::dataType(), owner).isOk());
+		EXPECT_TRUE(vfs.unlink(owner, dirId, "transient").isOk());
+		vfs.reclaim();
+	}
+
+	for (auto& reader : readers) {
+		reader.join();
+	}
+
+	EXPECT_EQ(0, nFailedWalks);
+	EXPECT_EQ(3U, vfs.size());
+}
+
+
+TEST_F(MockFsTest, dentryCacheCanBeReplacedWhileWalksUseIt) {
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "dir", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId.isOk());
+	ASSERT_TRUE(vfs.mknode(*maybeDirId, "stable", fsId, MockFs::dataType(), owner).isOk());
+
+	constexpr int kReaders = 4;
+	constexpr int kIterations = 200;
+	std::atomic<bool> isDone{false};
+	std::atomic<int> nFailedWalks{0};
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < kReaders; ++i) {
+		readers.emplace_back([this, &isDone, &nFailedWalks]() {
+			while (!isDone.load()) {
+				if (!vfs.walk(owner, vfs.rootId(), StringView{"dir/stable"})) {
+					nFailedWalks += 1;
+				}
+
+				vfs.walk(owner, vfs.rootId(), StringView{"dir/missing"});
+			}
+		});
+	}
+
+	// Cache is dropped and recreated under the walks, and dropped caches are reclaimed
+	for (int j = 0; j < kIterations; ++j) {
+		vfs.enableDentryCache(16);
+		EXPECT_TRUE(vfs.dentryCacheStats().isSome());
+		vfs.disableDentryCache();
+		vfs.reclaim();
+	}
+
+	isDone.store(true);
+	for (auto& reader : readers) {
+		reader.join();
+	}
+
+	EXPECT_EQ(0, nFailedWalks);
+	EXPECT_TRUE(vfs.dentryCacheStats().isNone());
+}
+
+
+TEST_F(MockFsTest, concurrentCrossLinkingDoesNotDeadlock) {
+	auto maybeDirA = vfs.createDirectory(vfs.rootId(), "a", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirA.isOk());
+	auto maybeDirB = vfs.createDirectory(vfs.rootId(), "b", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirB.isOk());
+	auto maybeNodeA = vfs.mknode(*maybeDirA, "node", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNodeA.isOk());
+	auto maybeNodeB = vfs.mknode(*maybeDirB, "node", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(maybeNodeB.isOk());
+
+	constexpr int kIterations = 1000;
+	auto crossLink = [this](INode::Id dirId, INode::Id nodeId) {
+		for (int j = 0; j < kIterations; ++j) {
+			EXPECT_TRUE(vfs.link(owner, "link", dirId, nodeId).isOk());
+			EXPECT_TRUE(vfs.unlink(owner, dirId, "link").isOk());
+		}
+	};
+
+	// Each writer locks a directory along with a node of the other directory
+	std::thread writerA{crossLink, *maybeDirA, *maybeNodeB};
+	std::thread writerB{crossLink, *maybeDirB, *maybeNodeA};
+	writerA.join();
+	writerB.join();
+
+	EXPECT_EQ(5U, vfs.size());
+	EXPECT_EQ(1U, vfs.nodeById(*maybeNodeA).map([](INode const& node) { return node.nLinks; }).orElse(0));
+	EXPECT_EQ(1U, vfs.nodeById(*maybeNodeB).map([](INode const& node) { return node.nLinks; }).orElse(0));
+}
+
+
+TEST_F(MockFsTest, lockFreeReadsSurviveGrowthOfIndexAndDirectory) {
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "dir", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId.isOk());
+	auto const dirId = *maybeDirId;
+	ASSERT_TRUE(vfs.mknode(dirId, "stable", fsId, MockFs::dataType(), owner).isOk());
+
+	constexpr int kReaders = 4;
+	constexpr int kNodes = 300;
+	std::atomic<bool> isDone{false};
+	std::atomic<int> nFailedReads{0};
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < kReaders; ++i) {
+		readers.emplace_back([this, dirId, &isDone, &nFailedReads]() {
+			while (!isDone.load()) {
+				auto maybeEntry = vfs.walk(owner, vfs.rootId(), StringView{"dir/stable"});
+				if (!maybeEntry || !vfs.nodeById(dirId) || !vfs.nodeById((*maybeEntry).nodeId)) {
+					nFailedReads += 1;
+				}
+
+				// Transient nodes come and go: walking to them must only ever succeed or fail cleanly
+				vfs.walk(owner, vfs.rootId(), StringView{"dir/node-42"});
+			}
+		});
+	}
+
+	// Index and the table of the directory grow, then shrink, while they are read
+	for (int round = 0; round < 3; ++round) {
+		for (int j = 0; j < kNodes; ++j) {
+			auto const name = "node-" + std::to_string(j);
+			EXPECT_TRUE(vfs.mknode(dirId, StringView{name.data(), static_cast<StringView::size_type>(name.size())},
+								   fsId, MockFs::dataType(), owner).isOk());
+		}
+
+		for (int j = 0; j < kNodes; ++j) {
+			auto const name = "node-" + std::to_string(j);
+			EXPECT_TRUE(vfs.unlink(owner, dirId, StringView{name.data(), static_cast<StringView::size_type>(name.size())})
+						.isOk());
+		}
+		vfs.reclaim(kNodes);
+	}
+
+	isDone.store(true);
+	for (auto& reader : readers) {
+		reader.join();
+	}
+
+	EXPECT_EQ(0, nFailedReads);
+	EXPECT_EQ(3U, vfs.size());
+}
+
+
+TEST_F(MockFsTest, snapshotSeesNamespaceAsItWasTaken) {
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "dir", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId.isOk());
+	auto const dirId = *maybeDirId;
+	auto const aId = vfs.mknode(dirId, "a", fsId, MockFs::dataType(), owner);
+	auto const bId = vfs.mknode(dirId, "b", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(aId.isOk());
+	ASSERT_TRUE(bId.isOk());
+
+	auto const snapshot = vfs.snapshot();
+
+	ASSERT_TRUE(vfs.unlink(owner, dirId, "a").isOk());
+	ASSERT_TRUE(vfs.mknode(dirId, "c", fsId, MockFs::dataType(), owner).isOk());
+	auto bNode = *vfs.nodeById(*bId);
+	auto const bSize = bNode.dataSize;
+	bNode.dataSize = bSize + 100;
+	ASSERT_TRUE(vfs.updateNode(*bId, bNode).isOk());
+
+	// Live namespace
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), StringView{"dir/a"}).isError());
+	EXPECT_TRUE(vfs.walk(owner, vfs.rootId(), StringView{"dir/c"}).isOk());
+	EXPECT_EQ(bSize + 100, (*vfs.nodeById(*bId)).dataSize);
+
+	// Namespace as it was when the snapshot was taken
+	auto const maybeA = snapshot.walk(owner, vfs.rootId(), StringView{"dir/a"});
+	ASSERT_TRUE(maybeA.isOk());
+	EXPECT_EQ(*aId, (*maybeA).nodeId);
+	EXPECT_TRUE(snapshot.nodeById(*aId).isSome());
+	EXPECT_TRUE(snapshot.walk(owner, vfs.rootId(), StringView{"dir/c"}).isError());
+	EXPECT_EQ(bSize, (*snapshot.nodeById(*bId)).dataSize);
+
+	std::vector<std::string> names;
+	auto maybeEnumerator = snapshot.enumerateDirectory(owner, dirId);
+	ASSERT_TRUE(maybeEnumerator.isOk());
+	for (auto entry : *maybeEnumerator) {
+		names.emplace_back(entry.name.data(), entry.name.size());
+	}
+	std::sort(names.begin(), names.end());
+	EXPECT_EQ((std::vector<std::string>{"a", "b"}), names);
+
+	EXPECT_TRUE(snapshot.enumerateDirectory(owner, *bId).isError());
+}
+
+
+TEST_F(MockFsTest, snapshotKeepsUnlinkedNodesUntilReleased) {
+	auto const nodeId = vfs.mknode(vfs.rootId(), "node", fsId, MockFs::dataType(), owner);
+	ASSERT_TRUE(nodeId.isOk());
+	auto const nDestroyed = _mockFs->nodesDestroyed();
+
+	{
+		auto const snapshot = vfs.snapshot();
+		ASSERT_TRUE(vfs.unlink(owner, vfs.rootId(), "node").isOk());
+		EXPECT_TRUE(vfs.nodeById(*nodeId).isNone());
+
+		// Node is still seen by the snapshot, so it is not destroyed
+		vfs.reclaim();
+		EXPECT_EQ(nDestroyed, _mockFs->nodesDestroyed());
+		EXPECT_EQ(1U, vfs.reclaimStats().pending);
+		EXPECT_TRUE(snapshot.nodeById(*nodeId).isSome());
+		EXPECT_TRUE(snapshot.walk(owner, vfs.rootId(), StringView{"node"}).isOk());
+	}
+
+	vfs.reclaim();
+	EXPECT_EQ(nDestroyed + 1, _mockFs->nodesDestroyed());
+	EXPECT_EQ(0U, vfs.reclaimStats().pending);
+
+	// Name can be reused once the snapshot is gone
+	EXPECT_TRUE(vfs.mknode(vfs.rootId(), "node", fsId, MockFs::dataType(), owner).isOk());
+}
+
+
+TEST_F(MockFsTest, snapshotIsNotAffectedByConcurrentWriters) {
+	auto maybeDirId = vfs.createDirectory(vfs.rootId(), "dir", owner, FilePermissions{0777});
+	ASSERT_TRUE(maybeDirId.isOk());
+	auto const dirId = *maybeDirId;
+
+	constexpr int kNodes = 50;
+	auto const nameOf = [](int i) { return "node-" + std::to_string(i); };
+	auto const viewOf = [](std::string const& name) {
+		return StringView{name.data(), static_cast<StringView::size_type>(name.size())};
+	};
+
+	for (int i = 0; i < kNodes; ++i) {
+		auto const name = nameOf(i);
+		ASSERT_TRUE(vfs.mknode(dirId, viewOf(name), fsId, MockFs::dataType(), owner).isOk());
+	}
+
+	auto snapshot = vfs.snapshot();
+	std::atomic<bool> isDone{false};
+	std::atomic<int> nInconsistentReads{0};
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 3; ++i) {
+		readers.emplace_back([this, dirId, &snapshot, &isDone, &nInconsistentReads]() {
+			while (!isDone.load()) {
+				auto maybeEnumerator = snapshot.enumerateDirectory(owner, dirId);
+				int nEntries = 0;
+				if (maybeEnumerator) {
+					for (auto entry : *maybeEnumerator) {
+						nEntries += snapshot.nodeById(entry.nodeId) ? 1 : 0;
+					}
+				}
+
+				if (nEntries != kNodes || !snapshot.walk(owner, vfs.rootId(), StringView{"dir/node-7"})) {
+					nInconsistentReads += 1;
+				}
+			}
+		});
+	}
+
+	// Writers replace the content of the directory, reclaiming what snapshot does not see
+	for (int round = 0; round < 3; ++round) {
+		for (int i = 0; i < kNodes; ++i) {
+			auto const name = nameOf(i);
+			EXPECT_TRUE(vfs.unlink(owner, dirId, viewOf(name)).isOk());
+			EXPECT_TRUE(vfs.mknode(dirId, viewOf(name), fsId, MockFs::dataType(), owner).isOk());
+		}
+		vfs.reclaim(kNodes);
+	}
+
+	isDone.store(true);
+	for (auto& reader : readers) {
+		reader.join();
+	}
+	EXPECT_EQ(0, nInconsistentReads);
+
+	// Nodes that only the snapshot saw are destroyed once it is released
+	EXPECT_EQ(static_cast<Vfs::size_type>(kNodes), vfs.reclaimStats().pending);
+	snapshot = vfs.snapshot();
+	vfs.reclaim(kNodes);
+	EXPECT_EQ(0U, vfs.reclaimStats().pending);
+}